@@ -0,0 +1,25 @@
+#include <glog/logging.h>
+#include "atoms.hpp"
+
+// Must match the order of AtomName, a missing entry conflicts with the
+// declaration in atoms.hpp
+const char* const ATOM_NAMES[] =
+{
+  "WM_PROTOCOLS",
+  "WM_DELETE_WINDOW",
+  "WM_WINDOW_ROLE",
+  "UTF8_STRING",
+  "_NET_SUPPORTED",
+  "_NET_SUPPORTING_WM_CHECK",
+  "_NET_CLIENT_LIST",
+  "_NET_CLIENT_LIST_STACKING",
+  "_NET_ACTIVE_WINDOW",
+  "_NET_WM_NAME",
+  "_NET_WM_ICON",
+  "_NET_WM_PING",
+};
+
+Atoms::Atoms(DisplayBackend* x)
+{
+  CHECK(x->InternAtoms(ATOM_NAMES, NUM_ATOM_NAMES, false, atoms_));
+}
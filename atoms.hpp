@@ -0,0 +1,39 @@
+#ifndef ATOMS_HPP
+#define ATOMS_HPP
+
+#include "display_backend.hpp"
+
+// Every atom the window manager uses.  The name table is immutable and
+// shared by all instances, each display interns it in a single round trip.
+enum AtomName
+{
+  ATOM_WM_PROTOCOLS,
+  ATOM_WM_DELETE_WINDOW,
+  ATOM_WM_WINDOW_ROLE,
+  ATOM_UTF8_STRING,
+  ATOM_NET_SUPPORTED,
+  ATOM_NET_SUPPORTING_WM_CHECK,
+  ATOM_NET_CLIENT_LIST,
+  ATOM_NET_CLIENT_LIST_STACKING,
+  ATOM_NET_ACTIVE_WINDOW,
+  ATOM_NET_WM_NAME,
+  ATOM_NET_WM_ICON,
+  ATOM_NET_WM_PING,
+  NUM_ATOM_NAMES
+};
+
+extern const char* const ATOM_NAMES[NUM_ATOM_NAMES];
+
+// The atoms of ATOM_NAMES on one display
+class Atoms
+{
+  public:
+    explicit Atoms(DisplayBackend* x);
+
+    Atom operator[](AtomName name) const { return atoms_[name]; }
+
+  private:
+    Atom atoms_[NUM_ATOM_NAMES];
+};
+
+#endif // ATOMS_HPP
@@ -0,0 +1,467 @@
+extern "C"
+{
+#include <X11/keysym.h>
+}
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "config.hpp"
+
+namespace
+{
+  const char* const WHITESPACE = " \t\r";
+
+  std::string Trim(const std::string& s)
+  {
+    const size_t begin = s.find_first_not_of(WHITESPACE);
+    if (begin == std::string::npos)
+    {
+      return std::string();
+    }
+    return s.substr(begin, s.find_last_not_of(WHITESPACE) - begin + 1);
+  }
+
+  // Splits at blanks.  Double quotes, also in the middle of a token as in
+  // title="a b", keep blanks.  In them \" and \\ stand for " and \, any other
+  // backslash is kept, so regexes like "/\d+/" read as written.
+  bool Tokenize(const std::string& s, std::vector<std::string>* tokens, std::string* error)
+  {
+    std::string token;
+    bool in_token = false, quoted = false;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+      const char c = s[i];
+      if (quoted)
+      {
+        if (c == '\\' && i + 1 < s.size() && (s[i + 1] == '"' || s[i + 1] == '\\'))
+        {
+          token += s[++i];
+        }
+        else if (c == '"')
+        {
+          quoted = false;
+        }
+        else
+        {
+          token += c;
+        }
+      }
+      else if (c == '"')
+      {
+        quoted = in_token = true;
+      }
+      else if (c == ' ' || c == '\t')
+      {
+        if (in_token)
+        {
+          tokens->push_back(token);
+          token.clear();
+          in_token = false;
+        }
+      }
+      else
+      {
+        token += c;
+        in_token = true;
+      }
+    }
+    if (quoted)
+    {
+      *error = "unterminated quote";
+      return false;
+    }
+    if (in_token)
+    {
+      tokens->push_back(token);
+    }
+    return true;
+  }
+
+  // Upper bounds, far beyond anything useful but small enough that nothing
+  // computed from them overflows
+  const long MAX_BORDER_WIDTH = 1000;
+  const long MAX_SNAP_DISTANCE = 10000;
+  // 1 hour
+  const long MAX_PING_MS = 3600000;
+  const long MAX_WORKSPACE = 1000;
+
+  // a decimal in [min, max]
+  bool ParseInt(const std::string& value, long min, long max, long* result)
+  {
+    char* end;
+    errno = 0;
+    *result = std::strtol(value.c_str(), &end, 10);
+    return !value.empty() && *end == '\0' && errno == 0 && *result >= min && *result <= max;
+  }
+
+  // #rrggbb, 0xrrggbb or decimal
+  bool ParseColor(const std::string& value, unsigned long* color)
+  {
+    const bool hash = !value.empty() && value[0] == '#';
+    const std::string digits = hash ? value.substr(1) : value;
+    char* end;
+    errno = 0;
+    *color = std::strtoul(digits.c_str(), &end, hash ? 16 : 0);
+    return !digits.empty() && *end == '\0' && errno == 0 && *color <= 0xffffff;
+  }
+
+  bool ParseBool(const std::string& value, bool* result)
+  {
+    if (value == "true" || value == "yes" || value == "1")
+    {
+      *result = true;
+      return true;
+    }
+    if (value == "false" || value == "no" || value == "0")
+    {
+      *result = false;
+      return true;
+    }
+    return false;
+  }
+
+  // Mod1+Shift+F4 close_window
+  bool ParseBinding(const std::vector<std::string>& tokens, KeyBinding* binding, std::string* error)
+  {
+    if (tokens.size() != 2)
+    {
+      *error = "expected bind = <modifiers+key> <action>";
+      return false;
+    }
+
+    std::vector<std::string> keys;
+    std::istringstream combination(tokens[0]);
+    std::string key;
+    while (std::getline(combination, key, '+'))
+    {
+      keys.push_back(key);
+    }
+    if (keys.empty() || keys.back().empty())
+    {
+      *error = "missing key in " + tokens[0];
+      return false;
+    }
+
+    binding->modifiers = 0;
+    for (size_t i = 0; i + 1 < keys.size(); ++i)
+    {
+      const std::string& modifier = keys[i];
+      if (modifier == "Shift")
+      {
+        binding->modifiers |= ShiftMask;
+      }
+      else if (modifier == "Control" || modifier == "Ctrl")
+      {
+        binding->modifiers |= ControlMask;
+      }
+      else if (modifier == "Mod1" || modifier == "Alt")
+      {
+        binding->modifiers |= Mod1Mask;
+      }
+      else if (modifier == "Mod4" || modifier == "Super")
+      {
+        binding->modifiers |= Mod4Mask;
+      }
+      else
+      {
+        *error = "unknown modifier " + modifier;
+        return false;
+      }
+    }
+    binding->keysym = XStringToKeysym(keys.back().c_str());
+    if (binding->keysym == NoSymbol)
+    {
+      *error = "unknown key " + keys.back();
+      return false;
+    }
+
+    if (tokens[1] == "close_window")
+    {
+      binding->action = ACTION_CLOSE_WINDOW;
+    }
+    else if (tokens[1] == "next_window")
+    {
+      binding->action = ACTION_NEXT_WINDOW;
+    }
+    else
+    {
+      *error = "unknown action " + tokens[1];
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseRuleAction(const std::string& token, RuleActions* actions)
+  {
+    const size_t equals = token.find('=');
+    const std::string key = token.substr(0, equals);
+    const std::string value = equals == std::string::npos ? std::string() : token.substr(equals + 1);
+    long workspace;
+    char end;
+    if (key == "workspace" && ParseInt(value, 0, MAX_WORKSPACE, &workspace))
+    {
+      actions->workspace = workspace;
+    }
+    else if (token == "floating")
+    {
+      actions->layout = RuleActions::LAYOUT_FLOATING;
+    }
+    else if (token == "tiling")
+    {
+      actions->layout = RuleActions::LAYOUT_TILING;
+    }
+    else if (key == "size" &&
+             std::sscanf(value.c_str(), "%dx%d%c", &actions->width, &actions->height, &end) == 2 &&
+             actions->width > 0 && actions->height > 0)
+    {
+      // parsed in place
+    }
+    else if (token == "no_focus")
+    {
+      actions->no_focus = true;
+    }
+    else if (token == "skip_alt_tab")
+    {
+      actions->skip_alt_tab = true;
+    }
+    else
+    {
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseRuleMatch(const std::string& token, Rule* rule)
+  {
+    const size_t equals = token.find('=');
+    if (equals == std::string::npos)
+    {
+      return false;
+    }
+    const std::string key = token.substr(0, equals);
+    const std::string value = token.substr(equals + 1);
+    if (key == "class")
+    {
+      rule->wm_class = value;
+    }
+    else if (key == "instance")
+    {
+      rule->instance = value;
+    }
+    else if (key == "role")
+    {
+      rule->role = value;
+    }
+    else if (key == "title")
+    {
+      rule->title = value;
+    }
+    else
+    {
+      return false;
+    }
+    return true;
+  }
+
+  // class=Foo title="*bar*" -> workspace=2 floating
+  bool ParseRule(const std::vector<std::string>& tokens, Rule* rule, std::string* error)
+  {
+    bool actions = false;
+    for (const std::string& token : tokens)
+    {
+      if (!actions && token == "->")
+      {
+        actions = true;
+      }
+      else if (actions ? !ParseRuleAction(token, &rule->actions) : !ParseRuleMatch(token, rule))
+      {
+        *error = std::string(actions ? "invalid rule action " : "invalid rule match ") + token;
+        return false;
+      }
+    }
+    if (!actions)
+    {
+      *error = "expected rule = <matches> -> <actions>";
+      return false;
+    }
+    return true;
+  }
+
+  // Everything but bind and rule
+  bool ParseSetting(const std::string& key, const std::string& value, Config* config)
+  {
+    long number;
+    if (key == "border_width" || key == "snap_distance")
+    {
+      if (!ParseInt(value, 0, key == "border_width" ? MAX_BORDER_WIDTH : MAX_SNAP_DISTANCE, &number))
+      {
+        return false;
+      }
+      if (key == "border_width")
+      {
+        config->border_width = number;
+      }
+      else
+      {
+        config->snap_distance = number;
+      }
+      return true;
+    }
+    if (key == "ping_timeout" || key == "ping_interval")
+    {
+      if (!ParseInt(value, 1, MAX_PING_MS, &number))
+      {
+        return false;
+      }
+      (key == "ping_timeout" ? config->ping_timeout : config->ping_interval) = number;
+      return true;
+    }
+    if (key == "border_color")
+    {
+      return ParseColor(value, &config->border_color);
+    }
+    if (key == "background_color")
+    {
+      return ParseColor(value, &config->background_color);
+    }
+    if (key == "unresponsive_border_color")
+    {
+      return ParseColor(value, &config->unresponsive_border_color);
+    }
+    if (key == "frameless")
+    {
+      return ParseBool(value, &config->frameless);
+    }
+    if (key == "trace_latency")
+    {
+      return ParseBool(value, &config->trace_latency);
+    }
+    if (key == "export_state")
+    {
+      return ParseBool(value, &config->export_state);
+    }
+    if (key == "prefetch")
+    {
+      return ParseBool(value, &config->prefetch);
+    }
+    return false;
+  }
+}
+
+std::shared_ptr<const Config> DefaultConfig()
+{
+  static const std::shared_ptr<const Config> config = [] ()
+  {
+    std::shared_ptr<Config> defaults = std::make_shared<Config>();
+    defaults->key_bindings.push_back(KeyBinding{Mod1Mask, XK_F4, ACTION_CLOSE_WINDOW});
+    defaults->key_bindings.push_back(KeyBinding{Mod1Mask, XK_Tab, ACTION_NEXT_WINDOW});
+    std::string error;
+    defaults->rules = RuleSet::Compile(std::vector<Rule>(), &error);
+    return std::shared_ptr<const Config>(defaults);
+  }();
+  return config;
+}
+
+std::shared_ptr<const Config> ParseConfig(const std::string& text, std::string* error)
+{
+  std::shared_ptr<Config> config = std::make_shared<Config>(*DefaultConfig());
+  std::vector<KeyBinding> bindings;
+  std::vector<Rule> rules;
+
+  std::istringstream lines(text);
+  std::string line;
+  for (int line_number = 1; std::getline(lines, line); ++line_number)
+  {
+    line = Trim(line);
+    if (line.empty() || line[0] == '#')
+    {
+      continue;
+    }
+
+    std::string line_error;
+    const size_t equals = line.find('=');
+    const std::string key = Trim(line.substr(0, equals));
+    const std::string value = equals == std::string::npos ? std::string() : Trim(line.substr(equals + 1));
+    std::vector<std::string> tokens;
+    if (equals == std::string::npos)
+    {
+      line_error = "expected <key> = <value>";
+    }
+    else if (key == "bind")
+    {
+      KeyBinding binding;
+      if (Tokenize(value, &tokens, &line_error) && ParseBinding(tokens, &binding, &line_error))
+      {
+        bindings.push_back(binding);
+      }
+    }
+    else if (key == "rule")
+    {
+      Rule rule;
+      if (Tokenize(value, &tokens, &line_error) && ParseRule(tokens, &rule, &line_error))
+      {
+        rules.push_back(rule);
+      }
+    }
+    else if (!ParseSetting(key, value, config.get()))
+    {
+      line_error = "invalid setting " + key + " = " + value;
+    }
+
+    if (!line_error.empty())
+    {
+      *error = "line " + std::to_string(line_number) + ": " + line_error;
+      return nullptr;
+    }
+  }
+
+  if (!bindings.empty())
+  {
+    config->key_bindings = bindings;
+  }
+  config->rules = RuleSet::Compile(rules, error);
+  if (!config->rules)
+  {
+    return nullptr;
+  }
+  return config;
+}
+
+std::shared_ptr<const Config> LoadConfig(const std::string& path, std::string* error)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    if (errno == ENOENT)
+    {
+      return DefaultConfig();
+    }
+    *error = path + ": can't read";
+    return nullptr;
+  }
+  std::ostringstream text;
+  text << file.rdbuf();
+  std::shared_ptr<const Config> config = ParseConfig(text.str(), error);
+  if (!config)
+  {
+    *error = path + ": " + *error;
+  }
+  return config;
+}
+
+std::string ConfigPath()
+{
+  if (const char* path = std::getenv("WM_CONFIG"))
+  {
+    return path;
+  }
+  if (const char* config_home = std::getenv("XDG_CONFIG_HOME"))
+  {
+    return std::string(config_home) + "/windowmaker9000/config";
+  }
+  const char* home = std::getenv("HOME");
+  return std::string(home ? home : ".") + "/.config/windowmaker9000/config";
+}
@@ -0,0 +1,114 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rules.hpp"
+
+// What a key binding does
+enum Action
+{
+  ACTION_CLOSE_WINDOW,
+  ACTION_NEXT_WINDOW,
+};
+
+// Display independent key binding, keycodes are resolved per display
+struct KeyBinding
+{
+  unsigned int modifiers;
+  KeySym keysym;
+  Action action;
+
+  bool operator==(const KeyBinding& other) const
+  {
+    return modifiers == other.modifiers && keysym == other.keysym && action == other.action;
+  }
+};
+
+// Window manager settings.  Immutable once built and shared between every
+// WindowManager instance of the process.
+struct Config
+{
+  unsigned int border_width = 3;
+  unsigned long border_color = 0xff0000;
+  unsigned long background_color = 0x0000ff;
+
+  // Manage clients in place instead of reparenting them into frames.  Saves
+  // a server window and the reparenting round of requests per client, at
+  // the cost of decorations.
+  bool frameless = false;
+
+  // _NET_WM_PING: how long (in ms) a client has to answer before it's
+  // marked unresponsive, and how often the focused client is pinged
+  unsigned int ping_timeout = 3000;
+  unsigned int ping_interval = 10000;
+  // border of unresponsive clients
+  unsigned long unresponsive_border_color = 0x808080;
+
+  // Trace input to applied latency of drags and alt+tab, see LatencyTracer
+  bool trace_latency = false;
+
+  // Publish clients, geometry and focus in shared memory, see StateExport
+  bool export_state = false;
+
+  // Fetch titles, icons and WM_PROTOCOLS off the event loop, see Prefetcher.
+  // Costs a second connection and a thread per display.
+  bool prefetch = true;
+
+  // how close (in pixels) a dragged edge has to get to another edge to snap
+  int snap_distance = 12;
+
+  std::vector<KeyBinding> key_bindings;
+
+  // Per application rules, never nullptr
+  std::shared_ptr<const RuleSet> rules;
+};
+
+// Built-in settings: alt+F4 closes, alt+tab cycles
+std::shared_ptr<const Config> DefaultConfig();
+
+// Parses a config file on top of DefaultConfig().  One setting per line,
+// # starts a comment line:
+//
+//   border_width = 3
+//   border_color = #ff0000
+//   background_color = #0000ff
+//   unresponsive_border_color = #808080
+//   snap_distance = 12
+//   ping_timeout = 3000
+//   ping_interval = 10000
+//   frameless = false
+//   trace_latency = false
+//   export_state = false
+//   prefetch = true
+//   bind = Mod1+F4 close_window
+//   bind = Mod1+Tab next_window
+//   rule = class=Firefox role=browser -> workspace=2
+//   rule = title="*Save As*" -> floating size=800x600 skip_alt_tab
+//   rule = title="/^Terminal [0-9]+$/" -> tiling no_focus
+//   rule = title="/^\w+ - \d+%$/" -> skip_alt_tab
+//
+// Any bind line replaces the default bindings.  Rules match on class,
+// instance, role and title (see Rule) and set workspace, floating or tiling,
+// size, no_focus and skip_alt_tab.  Double quotes keep blanks; inside them
+// \" is a quote and \\ a backslash, other backslashes are kept as they are
+// for regexes.  Returns nullptr with error set, naming the line, if anything
+// doesn't parse.  Numbers are bounded: border_width up to 1000,
+// snap_distance up to 10000, ping_timeout and ping_interval up to 3600000
+// (an hour) and workspace up to 1000.
+std::shared_ptr<const Config> ParseConfig(const std::string& text, std::string* error);
+
+// Reads and parses path, a file that doesn't exist gives DefaultConfig()
+std::shared_ptr<const Config> LoadConfig(const std::string& path, std::string* error);
+
+// $WM_CONFIG, otherwise windowmaker9000/config in $XDG_CONFIG_HOME or
+// ~/.config
+std::string ConfigPath();
+
+#endif // CONFIG_HPP
@@ -0,0 +1,158 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "config_watcher.hpp"
+
+namespace
+{
+  // Events that leave a complete file behind: written in place, or renamed
+  // over the old one.  IN_CREATE would catch a half written file.
+  const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+  // false if path can't be opened or didn't read in full, e.g. an editor
+  // deleted or truncated it mid save
+  bool ReadFile(const std::string& path, std::string* text)
+  {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0)
+    {
+      close(fd);
+      return false;
+    }
+    std::string contents(status.st_size, '\0');
+    size_t offset = 0;
+    while (offset < contents.size())
+    {
+      const ssize_t length = read(fd, &contents[offset], contents.size() - offset);
+      if (length < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (length <= 0)
+      {
+        break;
+      }
+      offset += length;
+    }
+    close(fd);
+    if (offset < contents.size())
+    {
+      return false;
+    }
+    *text = std::move(contents);
+    return true;
+  }
+}
+
+std::unique_ptr<ConfigWatcher> ConfigWatcher::Start(const std::string& path, Callback callback)
+{
+  const size_t slash = path.rfind('/');
+  const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+
+  const int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  PCHECK(inotify_fd >= 0) << "inotify_init1";
+  if (inotify_add_watch(inotify_fd, directory.c_str(), WATCH_MASK) < 0)
+  {
+    PLOG(WARNING) << "Not watching " << path << " for changes";
+    close(inotify_fd);
+    return nullptr;
+  }
+  return std::unique_ptr<ConfigWatcher>(new ConfigWatcher(path, std::move(callback), inotify_fd));
+}
+
+ConfigWatcher::ConfigWatcher(const std::string& path, Callback callback, int inotify_fd)
+    : path_(path),
+      name_(path.substr(path.rfind('/') + 1)),
+      callback_(std::move(callback)),
+      inotify_fd_(inotify_fd),
+      stop_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+  ReadFile(path, &text_);
+  PCHECK(stop_fd_ >= 0) << "eventfd";
+  thread_ = std::thread(&ConfigWatcher::Run, this);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+  const uint64_t one = 1;
+  PCHECK(write(stop_fd_, &one, sizeof(one)) == sizeof(one)) << "eventfd write";
+  thread_.join();
+  close(inotify_fd_);
+  close(stop_fd_);
+}
+
+void ConfigWatcher::Run()
+{
+  pollfd fds[2];
+  fds[0].fd = inotify_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = stop_fd_;
+  fds[1].events = POLLIN;
+  for (;;)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      PCHECK(errno == EINTR) << "poll";
+      continue;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+      return;
+    }
+
+    // one reload for however many events an editor's save produced
+    bool changed = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0)
+    {
+      for (ssize_t offset = 0; offset < length; )
+      {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+        changed = changed || (event->len > 0 && name_ == event->name);
+        offset += sizeof(inotify_event) + event->len;
+      }
+    }
+    PCHECK(length < 0 && (errno == EAGAIN || errno == EINTR)) << "inotify read";
+    if (changed)
+    {
+      Reload();
+    }
+  }
+}
+
+void ConfigWatcher::Reload()
+{
+  std::string text;
+  if (!ReadFile(path_, &text))
+  {
+    // a missing file is not an empty one, don't fall back to the defaults
+    LOG(ERROR) << "Can't read " << path_ << ", keeping the previous config";
+    return;
+  }
+  if (text == text_)
+  {
+    // saved without changes
+    return;
+  }
+  std::string error;
+  std::shared_ptr<const Config> config = ParseConfig(text, &error);
+  if (!config)
+  {
+    LOG(ERROR) << path_ << ": " << error << ", keeping the previous config";
+    return;
+  }
+  text_ = text;
+  LOG(INFO) << "Reloaded " << path_;
+  callback_(config);
+}
@@ -0,0 +1,53 @@
+#ifndef CONFIG_WATCHER_HPP
+#define CONFIG_WATCHER_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "config.hpp"
+
+// Reloads a config file whenever it changes, on a thread of its own so
+// reading and parsing never hold up an event loop.  Watches the file's
+// directory with inotify, which also catches editors that save by writing a
+// new file and renaming it over the old one.  A file that can't be read in
+// full or doesn't parse is logged and otherwise ignored, the previous config
+// stays in effect.
+class ConfigWatcher
+{
+  public:
+    // Called on the watcher thread with every successfully parsed change
+    typedef std::function<void(std::shared_ptr<const Config>)> Callback;
+
+    // Starts watching path, nullptr if inotify can't watch its directory
+    static std::unique_ptr<ConfigWatcher> Start(const std::string& path, Callback callback);
+
+    // Stops and joins the watcher thread
+    ~ConfigWatcher();
+
+  private:
+    // Invoked by Start()
+    ConfigWatcher(const std::string& path, Callback callback, int inotify_fd);
+
+    void Run();
+
+    // Rereads the file, calls callback_ if it changed and parses
+    void Reload();
+
+    const std::string path_;
+    // path_ without its directory, what inotify reports
+    const std::string name_;
+    const Callback callback_;
+
+    const int inotify_fd_;
+    // written by the destructor to stop Run()
+    const int stop_fd_;
+
+    // text of the last version handed to callback_, or the one at startup
+    std::string text_;
+
+    std::thread thread_;
+};
+
+#endif // CONFIG_WATCHER_HPP
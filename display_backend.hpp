@@ -0,0 +1,125 @@
+#ifndef DISPLAY_BACKEND_HPP
+#define DISPLAY_BACKEND_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The subset of Xlib the window manager talks to.  XlibBackend forwards to a
+// real connection, FakeBackend models windows in process so the handlers can
+// be driven without an X server.
+//
+// Methods mirror their Xlib counterparts minus the Display* argument.
+class DisplayBackend
+{
+  public:
+    virtual ~DisplayBackend() = default;
+
+    // connection
+    virtual Window Root() = 0;
+    virtual std::string Name() = 0;
+    virtual void Flush() = 0;
+    virtual void GrabServer() = 0;
+    virtual void UngrabServer() = 0;
+    // Another connection to the same server, for use on another thread.
+    // nullptr if there can't be one.
+    virtual std::unique_ptr<DisplayBackend> OpenConnection() = 0;
+
+    // Selects mask, which must contain SubstructureRedirectMask, on the root
+    // window and waits for the result.  Returns false if another window
+    // manager already holds the redirect.
+    virtual bool SelectRootInput(long mask) = 0;
+
+    // events
+    // Blocks until events are queued, the timer expires or Wakeup() is
+    // called.  Returns whether events are queued.
+    virtual bool WaitForEvents() = 0;
+    // Interrupts WaitForEvents(), may be called from any thread
+    virtual void Wakeup() = 0;
+    virtual void NextEvent(XEvent* event) = 0;
+    // like XEventsQueued(QueuedAfterReading), never flushes
+    virtual int EventsQueued() = 0;
+    // Serial of the last request issued.  An event carries the serial of
+    // the last request the server processed before sending it.
+    virtual unsigned long LastRequestSerial() = 0;
+
+    // timer, milliseconds on a monotonic clock
+    virtual uint64_t Now() = 0;
+    // Makes WaitForEvents() return at deadline, 0 disarms
+    virtual void SetTimer(uint64_t deadline) = 0;
+
+    // atoms and keyboard
+    virtual Atom InternAtom(const char* name, bool only_if_exists) = 0;
+    virtual bool InternAtoms(const char* const* names, int count, bool only_if_exists, Atom* atoms) = 0;
+    virtual KeyCode KeysymToKeycode(KeySym keysym) = 0;
+
+    // window queries, each one is a round trip on a real server
+    virtual bool QueryTree(Window win, std::vector<Window>* children) = 0;
+    virtual bool GetWindowAttributes(Window win, XWindowAttributes* attrs) = 0;
+    virtual bool GetGeometry(Window win,
+                             int* x,
+                             int* y,
+                             unsigned int* width,
+                             unsigned int* height,
+                             unsigned int* border_width) = 0;
+    virtual bool GetWMProtocols(Window win, std::vector<Atom>* protocols) = 0;
+    // Value of a format 8 property of any type, false if it isn't set
+    virtual bool GetStringProperty(Window win, Atom property, std::string* value) = 0;
+    // Text property in whatever encoding it was set in (STRING,
+    // COMPOUND_TEXT, UTF8_STRING, ...) converted to UTF-8
+    virtual bool GetTextProperty(Window win, Atom property, std::string* utf8) = 0;
+    // Format 32 property as an array, e.g. _NET_WM_ICON
+    virtual bool GetCardinalProperty(Window win, Atom property, std::vector<unsigned long>* values) = 0;
+
+    // window requests
+    virtual Window CreateSimpleWindow(Window parent,
+                                      int x,
+                                      int y,
+                                      unsigned int width,
+                                      unsigned int height,
+                                      unsigned int border_width,
+                                      unsigned long border,
+                                      unsigned long background) = 0;
+    virtual void DestroyWindow(Window win) = 0;
+    virtual void SelectInput(Window win, long mask) = 0;
+    virtual void SetWindowBorder(Window win, unsigned long border) = 0;
+    virtual void AddToSaveSet(Window win) = 0;
+    virtual void RemoveFromSaveSet(Window win) = 0;
+    virtual void ReparentWindow(Window win, Window parent, int x, int y) = 0;
+    virtual void MapWindow(Window win) = 0;
+    virtual void UnmapWindow(Window win) = 0;
+    virtual void ConfigureWindow(Window win, unsigned int value_mask, XWindowChanges* changes) = 0;
+    virtual void MoveWindow(Window win, int x, int y) = 0;
+    virtual void ResizeWindow(Window win, unsigned int width, unsigned int height) = 0;
+    virtual void RaiseWindow(Window win) = 0;
+    virtual void SetInputFocus(Window win, int revert_to, Time time) = 0;
+    virtual void KillClient(XID resource) = 0;
+    virtual bool SendEvent(Window win, bool propagate, long event_mask, XEvent* event) = 0;
+    virtual void ChangeProperty(Window win,
+                                Atom property,
+                                Atom type,
+                                int format,
+                                int mode,
+                                const unsigned char* data,
+                                int nelements) = 0;
+
+    // passive grabs, both always GrabModeAsync
+    virtual void GrabButton(unsigned int button,
+                            unsigned int modifiers,
+                            Window grab_window,
+                            bool owner_events,
+                            unsigned int event_mask) = 0;
+    virtual void GrabKey(int keycode,
+                         unsigned int modifiers,
+                         Window grab_window,
+                         bool owner_events) = 0;
+    virtual void UngrabButton(unsigned int button, unsigned int modifiers, Window grab_window) = 0;
+    virtual void UngrabKey(int keycode, unsigned int modifiers, Window grab_window) = 0;
+};
+
+#endif // DISPLAY_BACKEND_HPP
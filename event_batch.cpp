@@ -0,0 +1,160 @@
+#include <sstream>
+#include "event_batch.hpp"
+
+double EventLoopStats::AverageBatchSize() const
+{
+  return batches ? static_cast<double>(events_received) / batches : 0.0;
+}
+
+double EventLoopStats::CoalescingRatio() const
+{
+  return events_received
+      ? 1.0 - static_cast<double>(events_dispatched) / events_received
+      : 0.0;
+}
+
+std::string EventLoopStats::ToString() const
+{
+  std::ostringstream out;
+  out << "batches: " << batches
+      << ", received: " << events_received
+      << ", dispatched: " << events_dispatched
+      << ", avg batch: " << AverageBatchSize()
+      << ", max batch: " << max_batch_size
+      << ", coalesced: " << CoalescingRatio() * 100.0 << '%';
+  return out.str();
+}
+
+void EventBatch::Clear()
+{
+  events_.clear();
+}
+
+void EventBatch::Add(const XEvent& e)
+{
+  events_.push_back(e);
+}
+
+void EventBatch::Coalesce(const std::unordered_map<Window, Window>& clients)
+{
+  later_configure_.clear();
+  later_motion_.clear();
+  later_unmap_.clear();
+  later_destroy_.clear();
+  keep_.assign(events_.size(), true);
+
+  // walk backwards so that for every event we already know what follows it
+  for (size_t i = events_.size(); i-- > 0; )
+  {
+    XEvent& e = events_[i];
+    switch (e.type)
+    {
+      case ConfigureRequest:
+      {
+        const Window win = e.xconfigurerequest.window;
+        if (later_destroy_.count(win))
+        {
+          keep_[i] = false;
+          break;
+        }
+        auto later = later_configure_.find(win);
+        if (later != later_configure_.end())
+        {
+          MergeConfigureRequest(e.xconfigurerequest, &events_[later->second].xconfigurerequest);
+          keep_[i] = false;
+        }
+        else
+        {
+          later_configure_[win] = i;
+        }
+        break;
+      }
+      case MotionNotify:
+        // only the last position of a drag matters
+        if (!later_motion_.insert(e.xmotion.window).second)
+        {
+          keep_[i] = false;
+        }
+        break;
+      case ButtonPress:
+      case ButtonRelease:
+        // motion before a press/release belongs to a different drag
+        later_motion_.erase(e.xbutton.window);
+        break;
+      case MapRequest:
+      {
+        // window went away before we got around to framing it
+        const Window win = e.xmaprequest.window;
+        if (!clients.count(win) && (later_unmap_.count(win) || later_destroy_.count(win)))
+        {
+          keep_[i] = false;
+        }
+        // framing reads the geometry, a configure before the map has to be
+        // applied before it, not merged into one after it
+        later_configure_.erase(win);
+        break;
+      }
+      case MapNotify:
+        if (later_unmap_.count(e.xmap.window) || later_destroy_.count(e.xmap.window))
+        {
+          keep_[i] = false;
+        }
+        later_configure_.erase(e.xmap.window);
+        break;
+      case UnmapNotify:
+        later_unmap_.insert(e.xunmap.window);
+        break;
+      case DestroyNotify:
+        later_destroy_.insert(e.xdestroywindow.window);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // compact, preserving order
+  size_t out = 0;
+  for (size_t i = 0; i < events_.size(); ++i)
+  {
+    if (keep_[i])
+    {
+      events_[out++] = events_[i];
+    }
+  }
+  events_.resize(out);
+}
+
+void EventBatch::MergeConfigureRequest(const XConfigureRequestEvent& earlier,
+                                       XConfigureRequestEvent* later)
+{
+  const unsigned long missing = earlier.value_mask & ~later->value_mask;
+  if (missing & CWX)
+  {
+    later->x = earlier.x;
+  }
+  if (missing & CWY)
+  {
+    later->y = earlier.y;
+  }
+  if (missing & CWWidth)
+  {
+    later->width = earlier.width;
+  }
+  if (missing & CWHeight)
+  {
+    later->height = earlier.height;
+  }
+  if (missing & CWBorderWidth)
+  {
+    later->border_width = earlier.border_width;
+  }
+  if (missing & CWSibling)
+  {
+    later->above = earlier.above;
+  }
+  if (missing & CWStackMode)
+  {
+    later->detail = earlier.detail;
+  }
+  later->value_mask |= missing;
+}
@@ -0,0 +1,70 @@
+#ifndef EVENT_BATCH_HPP
+#define EVENT_BATCH_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Counters describing how well the event loop batches
+struct EventLoopStats
+{
+  uint64_t batches = 0;
+  // events read from the connection
+  uint64_t events_received = 0;
+  // events left after coalescing, i.e. handler invocations
+  uint64_t events_dispatched = 0;
+  size_t last_batch_size = 0;
+  size_t max_batch_size = 0;
+
+  double AverageBatchSize() const;
+  // fraction of received events that were coalesced away
+  double CoalescingRatio() const;
+
+  std::string ToString() const;
+};
+
+// Events drained from the connection in one event loop iteration.
+// Coalesce() drops events that are superseded by later events for the same
+// window so that the handlers only see the final state.
+class EventBatch
+{
+  public:
+    void Clear();
+    void Add(const XEvent& e);
+
+    // clients maps managed client windows to their frames
+    void Coalesce(const std::unordered_map<Window, Window>& clients);
+
+    // whether the batch last coalesced destroys win
+    bool Destroys(Window win) const { return later_destroy_.count(win) > 0; }
+
+    size_t size() const { return events_.size(); }
+    bool empty() const { return events_.empty(); }
+
+    std::vector<XEvent>::const_iterator begin() const { return events_.cbegin(); }
+    std::vector<XEvent>::const_iterator end() const { return events_.cend(); }
+
+  private:
+    // folds the fields of an earlier ConfigureRequest into a later one
+    // without overriding what the later one sets itself
+    static void MergeConfigureRequest(const XConfigureRequestEvent& earlier,
+                                      XConfigureRequestEvent* later);
+
+    std::vector<XEvent> events_;
+    std::vector<bool> keep_;
+
+    // scratch state for Coalesce(), kept around so the buckets are reused
+    std::unordered_map<Window, size_t> later_configure_;
+    std::unordered_set<Window> later_motion_;
+    std::unordered_set<Window> later_unmap_;
+    std::unordered_set<Window> later_destroy_;
+};
+
+#endif // EVENT_BATCH_HPP
@@ -0,0 +1,179 @@
+extern "C"
+{
+#include <X11/Xatom.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <glog/logging.h>
+#include "ewmh.hpp"
+
+namespace
+{
+  const char WM_NAME[] = "windowmaker9000";
+}
+
+Ewmh::Ewmh(DisplayBackend* x, const Atoms& atoms, Window root)
+    : x_(x),
+      atoms_(atoms),
+      root_(root),
+      check_window_(None),
+      active_window_(None),
+      active_window_dirty_(true)
+{
+  client_list_.atom = atoms_[ATOM_NET_CLIENT_LIST];
+  client_list_.published = 0;
+  client_list_.rewrite = true;
+
+  client_list_stacking_.atom = atoms_[ATOM_NET_CLIENT_LIST_STACKING];
+  client_list_stacking_.published = 0;
+  client_list_stacking_.rewrite = true;
+}
+
+void Ewmh::Init()
+{
+  check_window_ = x_->CreateSimpleWindow(root_, -1, -1, 1, 1, 0, 0, 0);
+
+  x_->ChangeProperty(
+      check_window_,
+      atoms_[ATOM_NET_SUPPORTING_WM_CHECK],
+      XA_WINDOW,
+      32,
+      PropModeReplace,
+      reinterpret_cast<const unsigned char*>(&check_window_),
+      1);
+  x_->ChangeProperty(
+      check_window_,
+      atoms_[ATOM_NET_WM_NAME],
+      atoms_[ATOM_UTF8_STRING],
+      8,
+      PropModeReplace,
+      reinterpret_cast<const unsigned char*>(WM_NAME),
+      strlen(WM_NAME));
+  x_->ChangeProperty(
+      root_,
+      atoms_[ATOM_NET_SUPPORTING_WM_CHECK],
+      XA_WINDOW,
+      32,
+      PropModeReplace,
+      reinterpret_cast<const unsigned char*>(&check_window_),
+      1);
+
+  const Atom supported[] =
+  {
+    atoms_[ATOM_NET_SUPPORTED],
+    atoms_[ATOM_NET_SUPPORTING_WM_CHECK],
+    atoms_[ATOM_NET_CLIENT_LIST],
+    atoms_[ATOM_NET_CLIENT_LIST_STACKING],
+    atoms_[ATOM_NET_ACTIVE_WINDOW],
+    atoms_[ATOM_NET_WM_NAME],
+    atoms_[ATOM_NET_WM_PING],
+  };
+  x_->ChangeProperty(
+      root_,
+      atoms_[ATOM_NET_SUPPORTED],
+      XA_ATOM,
+      32,
+      PropModeReplace,
+      reinterpret_cast<const unsigned char*>(supported),
+      sizeof(supported) / sizeof(supported[0]));
+}
+
+void Ewmh::AddClient(Window win)
+{
+  client_list_.windows.push_back(win);
+  client_list_stacking_.windows.push_back(win);
+}
+
+void Ewmh::RemoveClient(Window win)
+{
+  Remove(&client_list_, win);
+  Remove(&client_list_stacking_, win);
+  if (active_window_ == win)
+  {
+    SetActiveWindow(None);
+  }
+}
+
+void Ewmh::RaiseClient(Window win)
+{
+  std::vector<Window>& stacking = client_list_stacking_.windows;
+  if (!stacking.empty() && stacking.back() == win)
+  {
+    return;
+  }
+  Remove(&client_list_stacking_, win);
+  stacking.push_back(win);
+}
+
+void Ewmh::SetActiveWindow(Window win)
+{
+  if (active_window_ != win)
+  {
+    active_window_ = win;
+    active_window_dirty_ = true;
+  }
+}
+
+void Ewmh::Remove(ListProperty* list, Window win)
+{
+  auto i = std::find(list->windows.begin(), list->windows.end(), win);
+  if (i == list->windows.end())
+  {
+    return;
+  }
+  // dropping a window that was appended in this iteration doesn't touch
+  // what the server already has, anything else needs a full rewrite
+  if (static_cast<size_t>(i - list->windows.begin()) < list->published)
+  {
+    list->rewrite = true;
+  }
+  list->windows.erase(i);
+}
+
+void Ewmh::FlushList(ListProperty* list)
+{
+  if (list->rewrite)
+  {
+    x_->ChangeProperty(
+        root_,
+        list->atom,
+        XA_WINDOW,
+        32,
+        PropModeReplace,
+        reinterpret_cast<const unsigned char*>(list->windows.data()),
+        list->windows.size());
+  }
+  else if (list->published < list->windows.size())
+  {
+    x_->ChangeProperty(
+        root_,
+        list->atom,
+        XA_WINDOW,
+        32,
+        PropModeAppend,
+        reinterpret_cast<const unsigned char*>(list->windows.data() + list->published),
+        list->windows.size() - list->published);
+  }
+  list->published = list->windows.size();
+  list->rewrite = false;
+}
+
+void Ewmh::Flush()
+{
+  FlushList(&client_list_);
+  FlushList(&client_list_stacking_);
+
+  if (active_window_dirty_)
+  {
+    x_->ChangeProperty(
+        root_,
+        atoms_[ATOM_NET_ACTIVE_WINDOW],
+        XA_WINDOW,
+        32,
+        PropModeReplace,
+        reinterpret_cast<const unsigned char*>(&active_window_),
+        1);
+    active_window_dirty_ = false;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef EWMH_HPP
+#define EWMH_HPP
+
+#include <vector>
+
+#include "atoms.hpp"
+#include "display_backend.hpp"
+
+// Publishes the EWMH root window properties (_NET_CLIENT_LIST,
+// _NET_CLIENT_LIST_STACKING, _NET_ACTIVE_WINDOW, ...) for pagers and
+// taskbars.
+//
+// Handlers only record what changed; Flush() is called once per event loop
+// iteration and writes each dirty property at most once.  As long as an
+// iteration only added clients, the lists are extended with PropModeAppend
+// instead of being rewritten.
+class Ewmh
+{
+  public:
+    Ewmh(DisplayBackend* x, const Atoms& atoms, Window root);
+
+    // Sets up _NET_SUPPORTED and _NET_SUPPORTING_WM_CHECK.  Lists left behind
+    // by a previous window manager are replaced by the first Flush(), every
+    // property starts out dirty.
+    void Init();
+
+    // Bookkeeping, called from Frame()/Unframe() and focus/stacking changes
+    void AddClient(Window win);
+    void RemoveClient(Window win);
+    void RaiseClient(Window win);
+    void SetActiveWindow(Window win);
+
+    Window active_window() const { return active_window_; }
+
+    // Our own child of root, must not be framed
+    Window check_window() const { return check_window_; }
+
+    // Writes all pending property changes
+    void Flush();
+
+  private:
+    // Tracks one window list property and how it has to be written
+    struct ListProperty
+    {
+      Atom atom;
+      std::vector<Window> windows;
+      // Leading windows the server already has, valid while !rewrite.  The
+      // ones after them are appended by the next flush.
+      size_t published;
+      bool rewrite;
+    };
+
+    void Remove(ListProperty* list, Window win);
+    void FlushList(ListProperty* list);
+
+    DisplayBackend* x_;
+    const Atoms& atoms_;
+    const Window root_;
+
+    // Child of root advertised through _NET_SUPPORTING_WM_CHECK
+    Window check_window_;
+
+    // Mapping order
+    ListProperty client_list_;
+    // Bottom to top
+    ListProperty client_list_stacking_;
+
+    Window active_window_;
+    bool active_window_dirty_;
+};
+
+#endif // EWMH_HPP
@@ -0,0 +1,594 @@
+extern "C"
+{
+#include <X11/Xatom.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "fake_backend.hpp"
+
+namespace
+{
+  const char* const REQUEST_NAMES[] =
+  {
+    "SelectRootInput",
+    "GrabServer",
+    "UngrabServer",
+    "InternAtom",
+    "QueryTree",
+    "GetWindowAttributes",
+    "GetGeometry",
+    "GetWMProtocols",
+    "GetProperty",
+    "CreateWindow",
+    "DestroyWindow",
+    "SelectInput",
+    "ChangeWindowAttributes",
+    "ChangeSaveSet",
+    "ReparentWindow",
+    "MapWindow",
+    "UnmapWindow",
+    "ConfigureWindow",
+    "SetInputFocus",
+    "KillClient",
+    "SendEvent",
+    "ChangeProperty",
+    "GrabButton",
+    "GrabKey",
+    "UngrabButton",
+    "UngrabKey",
+  };
+
+  // leave room for the predefined atoms
+  const Atom FIRST_ATOM = XA_LAST_PREDEFINED + 1;
+}
+
+FakeBackend::FakeBackend(int screen_width, int screen_height, Window root)
+    : root_(root),
+      screen_width_(screen_width),
+      screen_height_(screen_height),
+      next_id_(0x200000),
+      create_unknown_windows_(false),
+      root_redirected_(false),
+      focus_(PointerRoot),
+      now_(1),
+      timer_deadline_(0)
+{
+  static_assert(sizeof(REQUEST_NAMES) / sizeof(REQUEST_NAMES[0]) == NUM_REQUESTS,
+                "REQUEST_NAMES out of sync with Request");
+  FakeWindow& root_window = windows_[root_];
+  root_window.width = screen_width_;
+  root_window.height = screen_height_;
+  root_window.mapped = true;
+  ResetCounters();
+}
+
+Window FakeBackend::CreateClient(int x, int y, unsigned int width, unsigned int height)
+{
+  const Window win = next_id_++;
+  AddWindow(win, root_, x, y, width, height);
+  return win;
+}
+
+void FakeBackend::AddWindow(Window win, Window parent, int x, int y, unsigned int width, unsigned int height)
+{
+  FakeWindow& fake = windows_[win];
+  fake.parent = parent;
+  fake.x = x;
+  fake.y = y;
+  fake.width = width;
+  fake.height = height;
+}
+
+void FakeBackend::RemoveWindow(Window win)
+{
+  windows_.erase(win);
+}
+
+void FakeBackend::SetClientProperty(Window win, Atom property, const std::string& value)
+{
+  windows_[win].properties[property].assign(value.begin(), value.end());
+}
+
+void FakeBackend::SetClientProtocols(Window win, const std::vector<Atom>& protocols)
+{
+  windows_[win].protocols = protocols;
+}
+
+const FakeBackend::FakeWindow* FakeBackend::window(Window win) const
+{
+  auto i = windows_.find(win);
+  return i == windows_.end() ? nullptr : &i->second;
+}
+
+uint64_t FakeBackend::total_requests() const
+{
+  uint64_t total = 0;
+  for (int i = 0; i < NUM_REQUESTS; ++i)
+  {
+    total += requests_[i];
+  }
+  return total;
+}
+
+uint64_t FakeBackend::round_trips() const
+{
+  return requests_[REQ_SELECT_ROOT_INPUT] +
+         requests_[REQ_INTERN_ATOM] +
+         requests_[REQ_QUERY_TREE] +
+         requests_[REQ_GET_WINDOW_ATTRIBUTES] +
+         requests_[REQ_GET_GEOMETRY] +
+         requests_[REQ_GET_WM_PROTOCOLS] +
+         requests_[REQ_GET_PROPERTY];
+}
+
+void FakeBackend::ResetCounters()
+{
+  std::fill(requests_, requests_ + NUM_REQUESTS, 0);
+  errors_ = 0;
+}
+
+const char* FakeBackend::RequestName(Request request)
+{
+  return REQUEST_NAMES[request];
+}
+
+FakeBackend::FakeWindow* FakeBackend::Lookup(Request request, Window win)
+{
+  ++requests_[request];
+  auto i = windows_.find(win);
+  if (i != windows_.end())
+  {
+    return &i->second;
+  }
+  if (create_unknown_windows_ && win != None)
+  {
+    FakeWindow& fake = windows_[win];
+    fake.parent = root_;
+    fake.width = screen_width_ / 2;
+    fake.height = screen_height_ / 2;
+    return &fake;
+  }
+  ++errors_;
+  return nullptr;
+}
+
+Window FakeBackend::Root()
+{
+  return root_;
+}
+
+std::string FakeBackend::Name()
+{
+  // unique per process, so concurrent runs don't share a StateExport segment
+  return "fake_" + std::to_string(getpid());
+}
+
+void FakeBackend::Flush() { }
+
+void FakeBackend::GrabServer()
+{
+  ++requests_[REQ_GRAB_SERVER];
+}
+
+void FakeBackend::UngrabServer()
+{
+  ++requests_[REQ_UNGRAB_SERVER];
+}
+
+std::unique_ptr<DisplayBackend> FakeBackend::OpenConnection()
+{
+  // the window model isn't thread safe
+  return nullptr;
+}
+
+bool FakeBackend::SelectRootInput(long mask)
+{
+  ++requests_[REQ_SELECT_ROOT_INPUT];
+  if (root_redirected_)
+  {
+    return false;
+  }
+  root_redirected_ = true;
+  windows_[root_].event_mask = mask;
+  return true;
+}
+
+bool FakeBackend::WaitForEvents()
+{
+  return !events_.empty();
+}
+
+void FakeBackend::Wakeup() { }
+
+void FakeBackend::NextEvent(XEvent* event)
+{
+  // a real connection would block forever
+  CHECK(!events_.empty()) << "NextEvent() on an empty fake event queue";
+  *event = events_.front();
+  events_.pop_front();
+}
+
+int FakeBackend::EventsQueued()
+{
+  return events_.size();
+}
+
+unsigned long FakeBackend::LastRequestSerial()
+{
+  // counters restart on ResetCounters(), queued events carry serial 0
+  return total_requests();
+}
+
+uint64_t FakeBackend::Now()
+{
+  return now_;
+}
+
+void FakeBackend::SetTimer(uint64_t deadline)
+{
+  timer_deadline_ = deadline;
+}
+
+Atom FakeBackend::InternAtom(const char* name, bool only_if_exists)
+{
+  ++requests_[REQ_INTERN_ATOM];
+  auto i = atoms_.find(name);
+  if (i != atoms_.end())
+  {
+    return i->second;
+  }
+  if (only_if_exists)
+  {
+    return None;
+  }
+  const Atom atom = FIRST_ATOM + atoms_.size();
+  atoms_.emplace(name, atom);
+  return atom;
+}
+
+bool FakeBackend::InternAtoms(const char* const* names, int count, bool only_if_exists, Atom* atoms)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    atoms[i] = InternAtom(names[i], only_if_exists);
+  }
+  // one round trip for the lot
+  requests_[REQ_INTERN_ATOM] -= count > 0 ? count - 1 : 0;
+  return true;
+}
+
+KeyCode FakeBackend::KeysymToKeycode(KeySym keysym)
+{
+  // Xlib answers this from its cached keyboard mapping, no request
+  return static_cast<KeyCode>(8 + keysym % 248);
+}
+
+bool FakeBackend::QueryTree(Window win, std::vector<Window>* children)
+{
+  if (!Lookup(REQ_QUERY_TREE, win))
+  {
+    return false;
+  }
+  children->clear();
+  for (const auto& i : windows_)
+  {
+    if (i.second.parent == win)
+    {
+      children->push_back(i.first);
+    }
+  }
+  std::sort(children->begin(), children->end());
+  return true;
+}
+
+bool FakeBackend::GetWindowAttributes(Window win, XWindowAttributes* attrs)
+{
+  const FakeWindow* fake = Lookup(REQ_GET_WINDOW_ATTRIBUTES, win);
+  if (!fake)
+  {
+    return false;
+  }
+  memset(attrs, 0, sizeof(*attrs));
+  attrs->x = fake->x;
+  attrs->y = fake->y;
+  attrs->width = fake->width;
+  attrs->height = fake->height;
+  attrs->border_width = fake->border_width;
+  attrs->root = root_;
+  attrs->map_state = fake->mapped ? IsViewable : IsUnmapped;
+  attrs->override_redirect = fake->override_redirect;
+  attrs->your_event_mask = fake->event_mask;
+  return true;
+}
+
+bool FakeBackend::GetGeometry(Window win,
+                              int* x,
+                              int* y,
+                              unsigned int* width,
+                              unsigned int* height,
+                              unsigned int* border_width)
+{
+  const FakeWindow* fake = Lookup(REQ_GET_GEOMETRY, win);
+  if (!fake)
+  {
+    return false;
+  }
+  *x = fake->x;
+  *y = fake->y;
+  *width = fake->width;
+  *height = fake->height;
+  *border_width = fake->border_width;
+  return true;
+}
+
+bool FakeBackend::GetWMProtocols(Window win, std::vector<Atom>* protocols)
+{
+  const FakeWindow* fake = Lookup(REQ_GET_WM_PROTOCOLS, win);
+  if (!fake || fake->protocols.empty())
+  {
+    return false;
+  }
+  *protocols = fake->protocols;
+  return true;
+}
+
+bool FakeBackend::GetStringProperty(Window win, Atom property, std::string* value)
+{
+  const FakeWindow* fake = Lookup(REQ_GET_PROPERTY, win);
+  if (!fake)
+  {
+    return false;
+  }
+  auto i = fake->properties.find(property);
+  if (i == fake->properties.end())
+  {
+    return false;
+  }
+  value->assign(i->second.begin(), i->second.end());
+  return true;
+}
+
+bool FakeBackend::GetTextProperty(Window win, Atom property, std::string* utf8)
+{
+  // everything is UTF-8 here
+  return GetStringProperty(win, property, utf8);
+}
+
+bool FakeBackend::GetCardinalProperty(Window win, Atom property, std::vector<unsigned long>* values)
+{
+  // only string properties are modeled
+  Lookup(REQ_GET_PROPERTY, win);
+  return false;
+}
+
+Window FakeBackend::CreateSimpleWindow(Window parent,
+                                       int x,
+                                       int y,
+                                       unsigned int width,
+                                       unsigned int height,
+                                       unsigned int border_width,
+                                       unsigned long border,
+                                       unsigned long background)
+{
+  ++requests_[REQ_CREATE_WINDOW];
+  if (!windows_.count(parent))
+  {
+    ++errors_;
+  }
+  const Window win = next_id_++;
+  AddWindow(win, parent, x, y, width, height);
+  windows_[win].border_width = border_width;
+  windows_[win].border = border;
+  return win;
+}
+
+void FakeBackend::DestroyWindow(Window win)
+{
+  if (!Lookup(REQ_DESTROY_WINDOW, win))
+  {
+    return;
+  }
+  // children go with it
+  std::vector<Window> doomed(1, win);
+  for (size_t i = 0; i < doomed.size(); ++i)
+  {
+    for (const auto& j : windows_)
+    {
+      if (j.second.parent == doomed[i])
+      {
+        doomed.push_back(j.first);
+      }
+    }
+  }
+  for (const Window w : doomed)
+  {
+    windows_.erase(w);
+  }
+}
+
+void FakeBackend::SelectInput(Window win, long mask)
+{
+  if (FakeWindow* fake = Lookup(REQ_SELECT_INPUT, win))
+  {
+    fake->event_mask = mask;
+  }
+}
+
+void FakeBackend::SetWindowBorder(Window win, unsigned long border)
+{
+  if (FakeWindow* fake = Lookup(REQ_CHANGE_WINDOW_ATTRIBUTES, win))
+  {
+    fake->border = border;
+  }
+}
+
+void FakeBackend::AddToSaveSet(Window win)
+{
+  Lookup(REQ_CHANGE_SAVE_SET, win);
+}
+
+void FakeBackend::RemoveFromSaveSet(Window win)
+{
+  Lookup(REQ_CHANGE_SAVE_SET, win);
+}
+
+void FakeBackend::ReparentWindow(Window win, Window parent, int x, int y)
+{
+  FakeWindow* fake = Lookup(REQ_REPARENT_WINDOW, win);
+  if (!fake)
+  {
+    return;
+  }
+  if (!windows_.count(parent))
+  {
+    ++errors_;
+    return;
+  }
+  fake->parent = parent;
+  fake->x = x;
+  fake->y = y;
+}
+
+void FakeBackend::MapWindow(Window win)
+{
+  if (FakeWindow* fake = Lookup(REQ_MAP_WINDOW, win))
+  {
+    fake->mapped = true;
+  }
+}
+
+void FakeBackend::UnmapWindow(Window win)
+{
+  if (FakeWindow* fake = Lookup(REQ_UNMAP_WINDOW, win))
+  {
+    fake->mapped = false;
+  }
+}
+
+void FakeBackend::ConfigureWindow(Window win, unsigned int value_mask, XWindowChanges* changes)
+{
+  FakeWindow* fake = Lookup(REQ_CONFIGURE_WINDOW, win);
+  if (!fake)
+  {
+    return;
+  }
+  if (value_mask & CWX)
+  {
+    fake->x = changes->x;
+  }
+  if (value_mask & CWY)
+  {
+    fake->y = changes->y;
+  }
+  if (value_mask & CWWidth)
+  {
+    fake->width = changes->width;
+  }
+  if (value_mask & CWHeight)
+  {
+    fake->height = changes->height;
+  }
+  if (value_mask & CWBorderWidth)
+  {
+    fake->border_width = changes->border_width;
+  }
+}
+
+void FakeBackend::MoveWindow(Window win, int x, int y)
+{
+  if (FakeWindow* fake = Lookup(REQ_CONFIGURE_WINDOW, win))
+  {
+    fake->x = x;
+    fake->y = y;
+  }
+}
+
+void FakeBackend::ResizeWindow(Window win, unsigned int width, unsigned int height)
+{
+  if (FakeWindow* fake = Lookup(REQ_CONFIGURE_WINDOW, win))
+  {
+    fake->width = width;
+    fake->height = height;
+  }
+}
+
+void FakeBackend::RaiseWindow(Window win)
+{
+  Lookup(REQ_CONFIGURE_WINDOW, win);
+}
+
+void FakeBackend::SetInputFocus(Window win, int revert_to, Time time)
+{
+  if (Lookup(REQ_SET_INPUT_FOCUS, win))
+  {
+    focus_ = win;
+  }
+}
+
+void FakeBackend::KillClient(XID resource)
+{
+  if (Lookup(REQ_KILL_CLIENT, resource))
+  {
+    windows_.erase(resource);
+  }
+}
+
+bool FakeBackend::SendEvent(Window win, bool propagate, long event_mask, XEvent* event)
+{
+  return Lookup(REQ_SEND_EVENT, win) != nullptr;
+}
+
+void FakeBackend::ChangeProperty(Window win,
+                                 Atom property,
+                                 Atom type,
+                                 int format,
+                                 int mode,
+                                 const unsigned char* data,
+                                 int nelements)
+{
+  FakeWindow* fake = Lookup(REQ_CHANGE_PROPERTY, win);
+  if (!fake)
+  {
+    return;
+  }
+  // Xlib passes format 32 data as longs
+  const size_t unit = format == 32 ? sizeof(long) : format / 8;
+  std::vector<unsigned char>& value = fake->properties[property];
+  if (mode == PropModeReplace)
+  {
+    value.clear();
+  }
+  const size_t offset = mode == PropModePrepend ? 0 : value.size();
+  value.insert(value.begin() + offset, data, data + unit * nelements);
+}
+
+void FakeBackend::GrabButton(unsigned int button,
+                             unsigned int modifiers,
+                             Window grab_window,
+                             bool owner_events,
+                             unsigned int event_mask)
+{
+  Lookup(REQ_GRAB_BUTTON, grab_window);
+}
+
+void FakeBackend::GrabKey(int keycode,
+                          unsigned int modifiers,
+                          Window grab_window,
+                          bool owner_events)
+{
+  Lookup(REQ_GRAB_KEY, grab_window);
+}
+
+void FakeBackend::UngrabButton(unsigned int button, unsigned int modifiers, Window grab_window)
+{
+  Lookup(REQ_UNGRAB_BUTTON, grab_window);
+}
+
+void FakeBackend::UngrabKey(int keycode, unsigned int modifiers, Window grab_window)
+{
+  Lookup(REQ_UNGRAB_KEY, grab_window);
+}
@@ -0,0 +1,204 @@
+#ifndef FAKE_BACKEND_HPP
+#define FAKE_BACKEND_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "display_backend.hpp"
+
+// In-process stand-in for an X server.  Models the window tree (parent,
+// geometry, mapped state, properties) well enough for the handlers to run,
+// and counts every request the window manager issues.  Events are whatever
+// the caller queued with PushEvent(), nothing is synthesized.
+class FakeBackend : public DisplayBackend
+{
+  public:
+    enum Request
+    {
+      REQ_SELECT_ROOT_INPUT,
+      REQ_GRAB_SERVER,
+      REQ_UNGRAB_SERVER,
+      REQ_INTERN_ATOM,
+      REQ_QUERY_TREE,
+      REQ_GET_WINDOW_ATTRIBUTES,
+      REQ_GET_GEOMETRY,
+      REQ_GET_WM_PROTOCOLS,
+      REQ_GET_PROPERTY,
+      REQ_CREATE_WINDOW,
+      REQ_DESTROY_WINDOW,
+      REQ_SELECT_INPUT,
+      REQ_CHANGE_WINDOW_ATTRIBUTES,
+      REQ_CHANGE_SAVE_SET,
+      REQ_REPARENT_WINDOW,
+      REQ_MAP_WINDOW,
+      REQ_UNMAP_WINDOW,
+      REQ_CONFIGURE_WINDOW,
+      REQ_SET_INPUT_FOCUS,
+      REQ_KILL_CLIENT,
+      REQ_SEND_EVENT,
+      REQ_CHANGE_PROPERTY,
+      REQ_GRAB_BUTTON,
+      REQ_GRAB_KEY,
+      REQ_UNGRAB_BUTTON,
+      REQ_UNGRAB_KEY,
+      NUM_REQUESTS
+    };
+
+    struct FakeWindow
+    {
+      Window parent = None;
+      int x = 0;
+      int y = 0;
+      unsigned int width = 1;
+      unsigned int height = 1;
+      unsigned int border_width = 0;
+      unsigned long border = 0;
+      bool mapped = false;
+      bool override_redirect = false;
+      long event_mask = 0;
+      std::vector<Atom> protocols;
+      // format 8 bytes, or longs for format 32
+      std::unordered_map<Atom, std::vector<unsigned char>> properties;
+    };
+
+    // root can be set to the root id of a recording
+    FakeBackend(int screen_width = 1920, int screen_height = 1080, Window root = 1);
+
+    // Creates a top level window as a client would, returns its id
+    Window CreateClient(int x, int y, unsigned int width, unsigned int height);
+    // Models an existing window under a known id, e.g. from a recording
+    void AddWindow(Window win, Window parent, int x, int y, unsigned int width, unsigned int height);
+    // Client side destroy, doesn't count as a window manager request
+    void RemoveWindow(Window win);
+    // Client side format 8 property change, e.g. WM_CLASS, not counted either
+    void SetClientProperty(Window win, Atom property, const std::string& value);
+    // Client side WM_PROTOCOLS change
+    void SetClientProtocols(Window win, const std::vector<Atom>& protocols);
+
+    // Windows referenced before they were created are modelled on the fly
+    // instead of failing the request, for replaying recordings
+    void set_create_unknown_windows(bool create) { create_unknown_windows_ = create; }
+
+    void PushEvent(const XEvent& event) { events_.push_back(event); }
+
+    // The clock behind Now() only moves when told to
+    void AdvanceClock(uint64_t ms) { now_ += ms; }
+    // deadline of SetTimer(), 0 if disarmed
+    uint64_t timer_deadline() const { return timer_deadline_; }
+
+    const FakeWindow* window(Window win) const;
+    size_t num_windows() const { return windows_.size(); }
+
+    uint64_t requests(Request request) const { return requests_[request]; }
+    uint64_t total_requests() const;
+    // requests that wait for a reply on a real server
+    uint64_t round_trips() const;
+    // requests on windows that don't exist, BadWindow on a real server
+    uint64_t errors() const { return errors_; }
+    void ResetCounters();
+
+    static const char* RequestName(Request request);
+
+    Window Root() override;
+    std::string Name() override;
+    void Flush() override;
+    void GrabServer() override;
+    void UngrabServer() override;
+    std::unique_ptr<DisplayBackend> OpenConnection() override;
+    bool SelectRootInput(long mask) override;
+
+    bool WaitForEvents() override;
+    void Wakeup() override;
+    void NextEvent(XEvent* event) override;
+    int EventsQueued() override;
+    unsigned long LastRequestSerial() override;
+
+    uint64_t Now() override;
+    void SetTimer(uint64_t deadline) override;
+
+    Atom InternAtom(const char* name, bool only_if_exists) override;
+    bool InternAtoms(const char* const* names, int count, bool only_if_exists, Atom* atoms) override;
+    KeyCode KeysymToKeycode(KeySym keysym) override;
+
+    bool QueryTree(Window win, std::vector<Window>* children) override;
+    bool GetWindowAttributes(Window win, XWindowAttributes* attrs) override;
+    bool GetGeometry(Window win,
+                     int* x,
+                     int* y,
+                     unsigned int* width,
+                     unsigned int* height,
+                     unsigned int* border_width) override;
+    bool GetWMProtocols(Window win, std::vector<Atom>* protocols) override;
+    bool GetStringProperty(Window win, Atom property, std::string* value) override;
+    bool GetTextProperty(Window win, Atom property, std::string* utf8) override;
+    bool GetCardinalProperty(Window win, Atom property, std::vector<unsigned long>* values) override;
+
+    Window CreateSimpleWindow(Window parent,
+                              int x,
+                              int y,
+                              unsigned int width,
+                              unsigned int height,
+                              unsigned int border_width,
+                              unsigned long border,
+                              unsigned long background) override;
+    void DestroyWindow(Window win) override;
+    void SelectInput(Window win, long mask) override;
+    void SetWindowBorder(Window win, unsigned long border) override;
+    void AddToSaveSet(Window win) override;
+    void RemoveFromSaveSet(Window win) override;
+    void ReparentWindow(Window win, Window parent, int x, int y) override;
+    void MapWindow(Window win) override;
+    void UnmapWindow(Window win) override;
+    void ConfigureWindow(Window win, unsigned int value_mask, XWindowChanges* changes) override;
+    void MoveWindow(Window win, int x, int y) override;
+    void ResizeWindow(Window win, unsigned int width, unsigned int height) override;
+    void RaiseWindow(Window win) override;
+    void SetInputFocus(Window win, int revert_to, Time time) override;
+    void KillClient(XID resource) override;
+    bool SendEvent(Window win, bool propagate, long event_mask, XEvent* event) override;
+    void ChangeProperty(Window win,
+                        Atom property,
+                        Atom type,
+                        int format,
+                        int mode,
+                        const unsigned char* data,
+                        int nelements) override;
+
+    void GrabButton(unsigned int button,
+                    unsigned int modifiers,
+                    Window grab_window,
+                    bool owner_events,
+                    unsigned int event_mask) override;
+    void GrabKey(int keycode,
+                 unsigned int modifiers,
+                 Window grab_window,
+                 bool owner_events) override;
+    void UngrabButton(unsigned int button, unsigned int modifiers, Window grab_window) override;
+    void UngrabKey(int keycode, unsigned int modifiers, Window grab_window) override;
+
+  private:
+    // counts the request and looks up its target, nullptr if it doesn't exist
+    FakeWindow* Lookup(Request request, Window win);
+
+    const Window root_;
+    const int screen_width_;
+    const int screen_height_;
+    Window next_id_;
+    bool create_unknown_windows_;
+    bool root_redirected_;
+    Window focus_;
+    uint64_t now_;
+    uint64_t timer_deadline_;
+
+    std::unordered_map<Window, FakeWindow> windows_;
+    std::unordered_map<std::string, Atom> atoms_;
+    std::deque<XEvent> events_;
+
+    uint64_t requests_[NUM_REQUESTS];
+    uint64_t errors_;
+};
+
+#endif // FAKE_BACKEND_HPP
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <sstream>
+#include <time.h>
+#include <glog/logging.h>
+#include "latency_tracer.hpp"
+
+namespace
+{
+  const char* const INTERACTION_NAMES[] =
+  {
+    "move",
+    "resize",
+    "focus",
+  };
+
+  // samples kept per interaction
+  const size_t MAX_SAMPLES = 4096;
+
+  // requests in flight per window before the oldest is given up on
+  const size_t MAX_PENDING = 32;
+
+  // server timestamps further off than this are from another clock
+  const uint32_t MAX_INPUT_TO_APPLIED_MS = 60 * 1000;
+
+  void Add(std::vector<uint32_t>* samples, size_t index, uint32_t sample)
+  {
+    if (samples->size() < MAX_SAMPLES)
+    {
+      samples->push_back(sample);
+    }
+    else
+    {
+      (*samples)[index % MAX_SAMPLES] = sample;
+    }
+  }
+
+  // p-th percentile, samples is reordered
+  uint32_t Percentile(std::vector<uint32_t>* samples, double p)
+  {
+    const size_t n = std::min(samples->size() - 1, static_cast<size_t>(p * samples->size()));
+    std::nth_element(samples->begin(), samples->begin() + n, samples->end());
+    return (*samples)[n];
+  }
+
+  void Print(std::ostream& out, std::vector<uint32_t> samples, const char* unit)
+  {
+    if (samples.empty())
+    {
+      out << "-";
+      return;
+    }
+    const uint32_t p50 = Percentile(&samples, 0.50);
+    out << "p50 " << p50 << unit << " p99 " << Percentile(&samples, 0.99) << unit;
+  }
+}
+
+LatencyTracer::LatencyTracer()
+    : input_server_time_(0),
+      input_received_(0),
+      dropped_(0)
+{
+  static_assert(sizeof(INTERACTION_NAMES) / sizeof(INTERACTION_NAMES[0]) == NUM_INTERACTIONS,
+                "INTERACTION_NAMES out of sync with Interaction");
+}
+
+uint64_t LatencyTracer::NowMicros()
+{
+  timespec now;
+  PCHECK(clock_gettime(CLOCK_MONOTONIC, &now) == 0) << "clock_gettime";
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+void LatencyTracer::BeginInput(Time server_time, uint64_t received)
+{
+  input_server_time_ = server_time;
+  input_received_ = received;
+}
+
+void LatencyTracer::Expect(Interaction interaction, Window win, unsigned long serial)
+{
+  std::deque<Pending>& pending =
+      (interaction == INTERACTION_FOCUS ? pending_focus_ : pending_configure_)[win];
+  if (pending.size() == MAX_PENDING)
+  {
+    pending.pop_front();
+    ++dropped_;
+  }
+  pending.push_back(Pending{interaction, serial, input_server_time_, input_received_});
+}
+
+void LatencyTracer::OnConfigureNotify(Window win, unsigned long serial, uint64_t received)
+{
+  Complete(&pending_configure_, win, serial, received);
+}
+
+void LatencyTracer::OnFocusIn(Window win, unsigned long serial, uint64_t received)
+{
+  Complete(&pending_focus_, win, serial, received);
+}
+
+void LatencyTracer::Forget(Window win)
+{
+  pending_configure_.erase(win);
+  pending_focus_.erase(win);
+}
+
+void LatencyTracer::Complete(std::unordered_map<Window, std::deque<Pending>>* pending,
+                             Window win,
+                             unsigned long serial,
+                             uint64_t received)
+{
+  auto i = pending->find(win);
+  if (i == pending->end())
+  {
+    // not ours, e.g. a client configuring itself
+    return;
+  }
+  std::deque<Pending>& requests = i->second;
+  // processed before this event without a notification of their own
+  while (!requests.empty() && requests.front().serial < serial)
+  {
+    requests.pop_front();
+    ++dropped_;
+  }
+  // otherwise caused by some other request, e.g. a raise
+  const bool matched = !requests.empty() && requests.front().serial == serial;
+  Pending request;
+  if (matched)
+  {
+    request = requests.front();
+    requests.pop_front();
+  }
+  if (requests.empty())
+  {
+    pending->erase(i);
+  }
+  if (!matched)
+  {
+    return;
+  }
+
+  Samples& samples = samples_[request.interaction];
+  Add(&samples.receive_to_applied_us, samples.next, received - request.received);
+  // server time is a wrapping 32 bit millisecond counter
+  const uint32_t input_to_applied = static_cast<uint32_t>(received / 1000) - static_cast<uint32_t>(request.server_time);
+  if (input_to_applied < MAX_INPUT_TO_APPLIED_MS)
+  {
+    Add(&samples.input_to_applied_ms, samples.next, input_to_applied);
+  }
+  ++samples.next;
+  ++samples.total;
+}
+
+std::string LatencyTracer::Report() const
+{
+  std::ostringstream out;
+  out << "Latency";
+  for (int i = 0; i < NUM_INTERACTIONS; ++i)
+  {
+    const Samples& samples = samples_[i];
+    out << "\n  " << INTERACTION_NAMES[i] << " (" << samples.total << "): receive to applied ";
+    Print(out, samples.receive_to_applied_us, "us");
+    out << ", input to applied ";
+    Print(out, samples.input_to_applied_ms, "ms");
+  }
+  out << "\n  unanswered: " << dropped_;
+  return out.str();
+}
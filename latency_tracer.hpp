@@ -0,0 +1,101 @@
+#ifndef LATENCY_TRACER_HPP
+#define LATENCY_TRACER_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What an input asked for
+enum Interaction
+{
+  INTERACTION_MOVE,
+  INTERACTION_RESIZE,
+  INTERACTION_FOCUS,
+  NUM_INTERACTIONS
+};
+
+// Follows interactive input until the server reports it applied: a drag's
+// MotionNotify until the frame's ConfigureNotify, alt+tab's KeyPress until
+// the FocusIn of the newly focused client.  Opt-in through
+// Config::trace_latency.
+//
+// Requests are matched to notifications by serial, a request the server
+// processed without a notification (e.g. a move to where the frame already
+// is) is counted as unanswered instead of taking the next one's sample.
+//
+// Two latencies are kept per interaction: receive to applied, on our clock,
+// and input to applied, from the event's server timestamp.  The latter only
+// means something when the server's clock is CLOCK_MONOTONIC of this
+// machine, as with Xorg and Xvfb, samples that don't fit are dropped.
+class LatencyTracer
+{
+  public:
+    LatencyTracer();
+
+    // CLOCK_MONOTONIC in microseconds, the clock receive times are taken on
+    static uint64_t NowMicros();
+
+    // Starts tracing an input event received at received.  Following
+    // Expect() calls belong to it.
+    void BeginInput(Time server_time, uint64_t received);
+
+    // Request serial, issued for the current input, applied once win
+    // reports a ConfigureNotify (moves and resizes) or FocusIn (focus) with
+    // that serial
+    void Expect(Interaction interaction, Window win, unsigned long serial);
+
+    // Notifications from the server with the event's serial, received at
+    // received
+    void OnConfigureNotify(Window win, unsigned long serial, uint64_t received);
+    void OnFocusIn(Window win, unsigned long serial, uint64_t received);
+
+    // Drops everything still expected from a window that's going away
+    void Forget(Window win);
+
+    // p50/p99 per interaction
+    std::string Report() const;
+
+  private:
+    struct Pending
+    {
+      Interaction interaction;
+      unsigned long serial;
+      Time server_time;
+      uint64_t received;
+    };
+
+    // Most recent samples of one interaction, bounded so a long session
+    // doesn't grow without limit
+    struct Samples
+    {
+      std::vector<uint32_t> receive_to_applied_us;
+      std::vector<uint32_t> input_to_applied_ms;
+      size_t next = 0;
+      uint64_t total = 0;
+    };
+
+    void Complete(std::unordered_map<Window, std::deque<Pending>>* pending,
+                  Window win,
+                  unsigned long serial,
+                  uint64_t received);
+
+    Time input_server_time_;
+    uint64_t input_received_;
+
+    // in serial order per window
+    std::unordered_map<Window, std::deque<Pending>> pending_configure_;
+    std::unordered_map<Window, std::deque<Pending>> pending_focus_;
+    // requests the server never answered, e.g. a move to the same position
+    uint64_t dropped_;
+
+    Samples samples_[NUM_INTERACTIONS];
+};
+
+#endif // LATENCY_TRACER_HPP
@@ -1,18 +1,183 @@
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+
+#include <cctype>
+#include <clocale>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 #include <glog/logging.h>
+#include "config.hpp"
+#include "config_watcher.hpp"
 #include "window_manager.hpp"
+#include "xlib_backend.hpp"
 
+namespace
+{
+  // Resident set size of this process in KiB, -1 if unknown
+  long ResidentSetKiB()
+  {
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+    {
+      return -1;
+    }
+    long size, resident;
+    const bool ok = std::fscanf(statm, "%ld %ld", &size, &resident) == 2;
+    std::fclose(statm);
+    return ok ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+  }
+
+  // WM_RECORD_EVENTS as is for a single display, otherwise one file per
+  // display with the display name appended, e.g. events.bin._1 for ":1"
+  std::string RecordingPath(const std::string& path, const std::string& display, size_t num_displays)
+  {
+    if (num_displays == 1)
+    {
+      return path;
+    }
+    std::string suffixed = path + ".";
+    for (const char c : display)
+    {
+      suffixed += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    return suffixed;
+  }
+
+  // Settings the environment and the number of displays override, applied
+  // to every config read from the file
+  std::shared_ptr<const Config> WithOverrides(const std::shared_ptr<const Config>& file_config, size_t num_displays)
+  {
+    std::shared_ptr<Config> config = std::make_shared<Config>(*file_config);
+    // kiosk style deployments don't need decorations
+    config->frameless = config->frameless || std::getenv("WM_FRAMELESS") != nullptr;
+    // see tools/latency.sh
+    config->trace_latency = config->trace_latency || std::getenv("WM_TRACE_LATENCY") != nullptr;
+    // a prefetcher is a connection and a thread per display, what sharing
+    // one process is meant to save
+    config->prefetch = config->prefetch && (num_displays == 1 || std::getenv("WM_PREFETCH") != nullptr);
+    return config;
+  }
+
+  // Stopped on SIGINT/SIGTERM, so they get to log their final stats
+  std::vector<WindowManager*> running;
+
+  void OnTerminate(int)
+  {
+    // Stop() only stores a flag and writes an eventfd
+    for (WindowManager* window_manager : running)
+    {
+      window_manager->Stop();
+    }
+  }
+}
+
+// Usage: windowmaker9000 [display...]
+//
+// With more than one display a single process manages all of them, one
+// event loop thread per display, sharing the configuration.  Prefetching is
+// off then unless WM_PREFETCH is set, it would add a connection and a thread
+// per display.  Settings are read from ConfigPath() and reloaded whenever
+// the file changes.
+// WM_RECORD_EVENTS=path records each display's events for tools/replay.
 int main(int argc, char** argv)
 {
   google::InitGoogleLogging(argv[0]);
-  std::unique_ptr<WindowManager> window_manager(WindowManager::Create());
-  if(!window_manager)
+  // titles in COMPOUND_TEXT are converted through the locale
+  std::setlocale(LC_CTYPE, "");
+  // the prefetcher's connection lives on a thread of its own
+  XInitThreads();
+
+  std::vector<std::string> displays(argv + 1, argv + argc);
+  if (displays.empty())
+  {
+    // $DISPLAY
+    displays.emplace_back();
+  }
+  const std::string config_path = ConfigPath();
+  std::string error;
+  std::shared_ptr<const Config> file_config = LoadConfig(config_path, &error);
+  if (!file_config)
+  {
+    LOG(ERROR) << error;
+    return EXIT_FAILURE;
+  }
+  const std::shared_ptr<const Config> config = WithOverrides(file_config, displays.size());
+
+  std::vector<std::unique_ptr<WindowManager>> window_managers;
+  for (const std::string& display : displays)
+  {
+    std::unique_ptr<XlibBackend> backend = XlibBackend::Open(display);
+    if(!backend)
+    {
+      LOG(ERROR) << "Failed to init window manager for display " << display;
+      continue;
+    }
+
+    // raw event stream for tools/replay
+    const char* record_path = std::getenv("WM_RECORD_EVENTS");
+    if (record_path &&
+        !backend->RecordEvents(RecordingPath(record_path, backend->Name(), displays.size())))
+    {
+      return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<WindowManager> window_manager(WindowManager::Create(std::move(backend), config));
+    if (window_manager->Init())
+    {
+      window_managers.push_back(std::move(window_manager));
+    }
+  }
+  if (window_managers.empty())
   {
     LOG(ERROR) << "Failed to init window manager.";
     return EXIT_FAILURE;
   }
 
-  window_manager->Run();
+  const long rss = ResidentSetKiB();
+  LOG(INFO) << "Managing " << window_managers.size() << " display(s), RSS " << rss
+            << " KiB, " << rss / static_cast<long>(window_managers.size()) << " KiB per display";
+
+  for (const std::unique_ptr<WindowManager>& window_manager : window_managers)
+  {
+    running.push_back(window_manager.get());
+  }
+  std::signal(SIGINT, OnTerminate);
+  std::signal(SIGTERM, OnTerminate);
+
+  // live reload, every display switches to the new config between batches
+  std::unique_ptr<ConfigWatcher> watcher = ConfigWatcher::Start(
+      config_path,
+      [num_displays = displays.size()] (std::shared_ptr<const Config> file_config)
+      {
+        const std::shared_ptr<const Config> config = WithOverrides(file_config, num_displays);
+        for (WindowManager* window_manager : running)
+        {
+          window_manager->Reconfigure(config);
+        }
+      });
+
+  if (window_managers.size() == 1)
+  {
+    window_managers[0]->RunEventLoop();
+    return EXIT_SUCCESS;
+  }
+
+  std::vector<std::thread> threads;
+  for (const std::unique_ptr<WindowManager>& window_manager : window_managers)
+  {
+    threads.emplace_back(&WindowManager::RunEventLoop, window_manager.get());
+  }
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
 
   return EXIT_SUCCESS;
 }
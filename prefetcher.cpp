@@ -0,0 +1,167 @@
+extern "C"
+{
+#include <X11/Xatom.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "prefetcher.hpp"
+
+namespace
+{
+  // larger than any icon, X can't size a window beyond it either
+  const unsigned long MAX_ICON_DIMENSION = 65535;
+}
+
+std::unique_ptr<Prefetcher> Prefetcher::Start(std::unique_ptr<DisplayBackend> connection, ReadyCallback ready)
+{
+  if (!connection)
+  {
+    return nullptr;
+  }
+  return std::unique_ptr<Prefetcher>(new Prefetcher(std::move(connection), std::move(ready)));
+}
+
+Prefetcher::Prefetcher(std::unique_ptr<DisplayBackend> connection, ReadyCallback ready)
+    : x_(std::move(connection)),
+      atoms_(x_.get()),
+      ready_(std::move(ready)),
+      request_fd_(eventfd(0, EFD_CLOEXEC)),
+      stop_(false)
+{
+  PCHECK(request_fd_ >= 0) << "eventfd";
+  thread_ = std::thread(&Prefetcher::Run, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+  stop_ = true;
+  const uint64_t one = 1;
+  PCHECK(write(request_fd_, &one, sizeof(one)) == sizeof(one)) << "eventfd write";
+  thread_.join();
+  close(request_fd_);
+
+  ClientProperties* result;
+  while (results_.TryPop(&result))
+  {
+    delete result;
+  }
+}
+
+bool Prefetcher::Request(Window win, uint64_t generation)
+{
+  if (!requests_.TryPush(FetchRequest{win, generation}))
+  {
+    return false;
+  }
+  const uint64_t one = 1;
+  PCHECK(write(request_fd_, &one, sizeof(one)) == sizeof(one)) << "eventfd write";
+  return true;
+}
+
+bool Prefetcher::TakeResult(std::unique_ptr<ClientProperties>* result)
+{
+  ClientProperties* properties;
+  if (!results_.TryPop(&properties))
+  {
+    return false;
+  }
+  result->reset(properties);
+  return true;
+}
+
+void Prefetcher::Run()
+{
+  for (;;)
+  {
+    uint64_t count;
+    if (read(request_fd_, &count, sizeof(count)) < 0)
+    {
+      PCHECK(errno == EINTR) << "eventfd read";
+      continue;
+    }
+    if (stop_)
+    {
+      return;
+    }
+
+    // everything queued, each result is handed over as soon as it's there
+    // so a slow client doesn't hold back the ones after it
+    FetchRequest request;
+    while (!stop_ && requests_.TryPop(&request))
+    {
+      ClientProperties* result = Fetch(request).release();
+      while (!results_.TryPush(result))
+      {
+        // the event loop is behind
+        ready_();
+        if (stop_)
+        {
+          delete result;
+          return;
+        }
+        usleep(1000);
+      }
+      ready_();
+    }
+  }
+}
+
+std::unique_ptr<ClientProperties> Prefetcher::Fetch(const FetchRequest& request)
+{
+  const Window win = request.win;
+  std::unique_ptr<ClientProperties> properties(new ClientProperties());
+  properties->win = win;
+  properties->generation = request.generation;
+  properties->has_protocols = x_->GetWMProtocols(win, &properties->protocols);
+  if (!x_->GetTextProperty(win, atoms_[ATOM_NET_WM_NAME], &properties->title))
+  {
+    x_->GetTextProperty(win, XA_WM_NAME, &properties->title);
+  }
+  FetchIcon(win, properties.get());
+  return properties;
+}
+
+void Prefetcher::FetchIcon(Window win, ClientProperties* properties)
+{
+  // width, height, then width * height ARGB pixels, for each size offered
+  std::vector<unsigned long> data;
+  if (!x_->GetCardinalProperty(win, atoms_[ATOM_NET_WM_ICON], &data))
+  {
+    return;
+  }
+
+  // the smallest image at least ICON_SIZE wide, otherwise the largest
+  size_t best = data.size();
+  unsigned long best_width = 0;
+  for (size_t i = 0; i + 2 <= data.size(); )
+  {
+    const unsigned long width = data[i], height = data[i + 1];
+    // bounded before multiplying, so width * height can't wrap
+    if (width == 0 || height == 0 || width > MAX_ICON_DIMENSION || height > MAX_ICON_DIMENSION ||
+        width * height > data.size() - i - 2)
+    {
+      // truncated or garbage
+      break;
+    }
+    const bool fits = width >= ClientProperties::ICON_SIZE;
+    const bool best_fits = best_width >= ClientProperties::ICON_SIZE;
+    if (best == data.size() || (fits && (!best_fits || width < best_width)) || (!fits && !best_fits && width > best_width))
+    {
+      best = i;
+      best_width = width;
+    }
+    i += 2 + width * height;
+  }
+  if (best == data.size())
+  {
+    return;
+  }
+
+  properties->icon_width = data[best];
+  properties->icon_height = data[best + 1];
+  properties->icon.assign(data.begin() + best + 2, data.begin() + best + 2 + data[best] * data[best + 1]);
+}
@@ -0,0 +1,97 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atoms.hpp"
+#include "display_backend.hpp"
+#include "spsc_queue.hpp"
+
+// Per client properties that are slow to fetch or decode, fetched after the
+// client is framed and again whenever the client changes one of them
+struct ClientProperties
+{
+  Window win = None;
+  // what the request was tagged with
+  uint64_t generation = 0;
+  // WM_PROTOCOLS, has_protocols is false if the client didn't set any
+  bool has_protocols = false;
+  std::vector<Atom> protocols;
+  // _NET_WM_NAME, otherwise WM_NAME converted from its encoding, as UTF-8
+  std::string title;
+  // ARGB _NET_WM_ICON image closest to ICON_SIZE, empty if none
+  int icon_width = 0;
+  int icon_height = 0;
+  std::vector<uint32_t> icon;
+
+  // the icon size decorations and alt+tab would draw
+  static const int ICON_SIZE = 32;
+};
+
+// Fetches ClientProperties on a worker thread with a connection of its own,
+// so neither a large icon nor a client slow to answer holds up the event
+// loop.  Windows go in and results come back through lock-free queues; the
+// worker calls ready (e.g. DisplayBackend::Wakeup()) when there are results.
+class Prefetcher
+{
+  public:
+    typedef std::function<void()> ReadyCallback;
+
+    // Takes over connection, nullptr if there is none
+    static std::unique_ptr<Prefetcher> Start(std::unique_ptr<DisplayBackend> connection, ReadyCallback ready);
+
+    // Stops and joins the worker, results not taken are dropped
+    ~Prefetcher();
+
+    // Event loop thread.  Queues win for fetching, false if the queue is full.
+    // The result carries generation, so the caller can tell it apart from
+    // results of earlier requests for the same window id.
+    bool Request(Window win, uint64_t generation);
+
+    // Event loop thread.  The next result, false if there is none yet.
+    bool TakeResult(std::unique_ptr<ClientProperties>* result);
+
+  private:
+    // requests or results in flight
+    static const size_t QUEUE_SIZE = 1024;
+
+    struct FetchRequest
+    {
+      Window win;
+      uint64_t generation;
+    };
+
+    // Invoked by Start()
+    Prefetcher(std::unique_ptr<DisplayBackend> connection, ReadyCallback ready);
+
+    void Run();
+    std::unique_ptr<ClientProperties> Fetch(const FetchRequest& request);
+    void FetchIcon(Window win, ClientProperties* properties);
+
+    const std::unique_ptr<DisplayBackend> x_;
+    const Atoms atoms_;
+    const ReadyCallback ready_;
+
+    // event loop -> worker
+    SpscQueue<FetchRequest, QUEUE_SIZE> requests_;
+    // worker -> event loop, owned by whoever holds them
+    SpscQueue<ClientProperties*, QUEUE_SIZE> results_;
+
+    // counts requests, the worker blocks reading it
+    const int request_fd_;
+    std::atomic<bool> stop_;
+
+    std::thread thread_;
+};
+
+#endif // PREFETCHER_HPP
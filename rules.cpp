@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <glog/logging.h>
+#include "rules.hpp"
+
+namespace
+{
+  // * matches any run, ? any single byte
+  bool GlobMatch(const std::string& glob, const std::string& text)
+  {
+    size_t g = 0, t = 0;
+    // where to resume after the last *
+    size_t star = std::string::npos, star_text = 0;
+    while (t < text.size())
+    {
+      if (g < glob.size() && (glob[g] == '?' || glob[g] == text[t]))
+      {
+        ++g;
+        ++t;
+      }
+      else if (g < glob.size() && glob[g] == '*')
+      {
+        star = g++;
+        star_text = t;
+      }
+      else if (star != std::string::npos)
+      {
+        g = star + 1;
+        t = ++star_text;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    while (g < glob.size() && glob[g] == '*')
+    {
+      ++g;
+    }
+    return g == glob.size();
+  }
+
+  // Wildcard free runs of glob, every matching title contains all of them
+  std::vector<std::string> GlobLiterals(const std::string& glob)
+  {
+    std::vector<std::string> literals;
+    size_t begin = 0;
+    while (begin <= glob.size())
+    {
+      size_t end = glob.find_first_of("*?", begin);
+      if (end == std::string::npos)
+      {
+        end = glob.size();
+      }
+      if (end > begin)
+      {
+        literals.push_back(glob.substr(begin, end - begin));
+      }
+      begin = end + 1;
+    }
+    return literals;
+  }
+
+  // Literal runs every match of an ECMAScript regex contains,
+  // conservatively: none if there's any alternation, groups, classes and
+  // escapes only end runs
+  std::vector<std::string> RegexLiterals(const std::string& regex)
+  {
+    std::vector<std::string> literals;
+    if (regex.find('|') != std::string::npos)
+    {
+      return literals;
+    }
+    std::string run;
+    const auto end_run = [&literals, &run] ()
+    {
+      if (!run.empty())
+      {
+        literals.push_back(run);
+      }
+      run.clear();
+    };
+    for (size_t i = 0; i < regex.size(); ++i)
+    {
+      const char c = regex[i];
+      switch (c)
+      {
+        case '*':
+        case '?':
+        case '{':
+          // the previous character is optional
+          if (!run.empty())
+          {
+            run.pop_back();
+          }
+          end_run();
+          if (c == '{')
+          {
+            i = std::min(regex.find('}', i), regex.size());
+          }
+          break;
+        case '(':
+        case '[':
+        {
+          end_run();
+          // skip the whole group or class
+          const char close = c == '(' ? ')' : ']';
+          int depth = 0;
+          for (; i < regex.size(); ++i)
+          {
+            if (regex[i] == '\\')
+            {
+              ++i;
+            }
+            else if (regex[i] == c)
+            {
+              ++depth;
+            }
+            else if (regex[i] == close && --depth == 0)
+            {
+              break;
+            }
+          }
+          // a quantified group may not be there at all, either way the run
+          // after it starts over
+          break;
+        }
+        case '\\':
+          end_run();
+          ++i;
+          break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+          end_run();
+          break;
+        default:
+          run += c;
+      }
+    }
+    end_run();
+    return literals;
+  }
+
+  bool IsRegex(const std::string& title)
+  {
+    return title.size() >= 2 && title.front() == '/' && title.back() == '/';
+  }
+}
+
+void RuleActions::Merge(const RuleActions& other)
+{
+  if (other.workspace >= 0)
+  {
+    workspace = other.workspace;
+  }
+  if (other.layout != LAYOUT_UNSET)
+  {
+    layout = other.layout;
+  }
+  if (other.width > 0 && other.height > 0)
+  {
+    width = other.width;
+    height = other.height;
+  }
+  no_focus = no_focus || other.no_focus;
+  skip_alt_tab = skip_alt_tab || other.skip_alt_tab;
+}
+
+void RuleStats::Add(uint64_t ns)
+{
+  ++evaluations;
+  total_ns += ns;
+  max_ns = std::max(max_ns, ns);
+}
+
+std::string RuleStats::ToString() const
+{
+  std::ostringstream out;
+  out << "evaluations: " << evaluations
+      << ", avg: " << (evaluations ? total_ns / evaluations : 0) << "ns"
+      << ", max: " << max_ns << "ns";
+  return out.str();
+}
+
+std::shared_ptr<const RuleSet> RuleSet::Compile(const std::vector<Rule>& rules, std::string* error)
+{
+  std::shared_ptr<RuleSet> rule_set(new RuleSet());
+  rule_set->states_.emplace_back();
+  rule_set->rules_.reserve(rules.size());
+
+  // Title rules go into the automaton under their most distinctive literal,
+  // the one fewest other rules share, so a common prefix like "Document "
+  // doesn't make every rule a candidate for every title
+  std::vector<std::vector<std::string>> literals(rules.size());
+  std::unordered_map<std::string, int> literal_rules;
+  for (size_t i = 0; i < rules.size(); ++i)
+  {
+    const std::string& title = rules[i].title;
+    if (title.empty())
+    {
+      continue;
+    }
+    literals[i] = IsRegex(title) ? RegexLiterals(title.substr(1, title.size() - 2)) : GlobLiterals(title);
+    std::sort(literals[i].begin(), literals[i].end());
+    literals[i].erase(std::unique(literals[i].begin(), literals[i].end()), literals[i].end());
+    for (const std::string& literal : literals[i])
+    {
+      ++literal_rules[literal];
+    }
+  }
+
+  for (const Rule& rule : rules)
+  {
+    const uint32_t index = rule_set->rules_.size();
+    CompiledRule compiled;
+    compiled.rule = rule;
+    compiled.title_match = rule.title.empty() ? TITLE_ANY : IsRegex(rule.title) ? TITLE_REGEX : TITLE_GLOB;
+    rule_set->uses_class_ = rule_set->uses_class_ || !rule.wm_class.empty() || !rule.instance.empty();
+    rule_set->uses_role_ = rule_set->uses_role_ || !rule.role.empty();
+    rule_set->uses_title_ = rule_set->uses_title_ || !rule.title.empty();
+    if (compiled.title_match == TITLE_REGEX)
+    {
+      try
+      {
+        compiled.title_regex = std::regex(rule.title.substr(1, rule.title.size() - 2), std::regex::optimize);
+      }
+      catch (const std::regex_error& e)
+      {
+        *error = "invalid title regex " + rule.title + ": " + e.what();
+        return nullptr;
+      }
+    }
+
+    // most selective exact field first
+    if (!rule.wm_class.empty())
+    {
+      rule_set->by_class_[rule.wm_class].push_back(index);
+    }
+    else if (!rule.instance.empty())
+    {
+      rule_set->by_instance_[rule.instance].push_back(index);
+    }
+    else if (!rule.role.empty())
+    {
+      rule_set->by_role_[rule.role].push_back(index);
+    }
+    else if (literals[index].empty())
+    {
+      rule_set->unkeyed_.push_back(index);
+    }
+    else
+    {
+      // titles can only match if they contain the literal
+      const std::string* best = &literals[index].front();
+      for (const std::string& literal : literals[index])
+      {
+        const int shared = literal_rules[literal];
+        const int best_shared = literal_rules[*best];
+        if (shared < best_shared || (shared == best_shared && literal.size() > best->size()))
+        {
+          best = &literal;
+        }
+      }
+      rule_set->AddLiteral(*best, index);
+    }
+    rule_set->rules_.push_back(std::move(compiled));
+  }
+
+  rule_set->BuildAutomaton();
+  return rule_set;
+}
+
+RuleActions RuleSet::Match(const WindowProperties& properties) const
+{
+  std::vector<uint32_t> candidates(unkeyed_);
+  const auto add = [&candidates] (const std::unordered_map<std::string, std::vector<uint32_t>>& table,
+                                  const std::string& key)
+  {
+    auto i = table.find(key);
+    if (i != table.end())
+    {
+      candidates.insert(candidates.end(), i->second.begin(), i->second.end());
+    }
+  };
+  add(by_class_, properties.wm_class);
+  add(by_instance_, properties.instance);
+  add(by_role_, properties.role);
+  ScanTitle(properties.title, &candidates);
+
+  // in rule order, a literal can occur more than once
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  RuleActions actions;
+  for (const uint32_t index : candidates)
+  {
+    if (Matches(rules_[index], properties))
+    {
+      actions.Merge(rules_[index].rule.actions);
+    }
+  }
+  return actions;
+}
+
+bool RuleSet::Matches(const CompiledRule& compiled, const WindowProperties& properties) const
+{
+  const Rule& rule = compiled.rule;
+  if ((!rule.wm_class.empty() && rule.wm_class != properties.wm_class) ||
+      (!rule.instance.empty() && rule.instance != properties.instance) ||
+      (!rule.role.empty() && rule.role != properties.role))
+  {
+    return false;
+  }
+  switch (compiled.title_match)
+  {
+    case TITLE_ANY:
+      return true;
+    case TITLE_GLOB:
+      return GlobMatch(rule.title, properties.title);
+    case TITLE_REGEX:
+      return std::regex_search(properties.title, compiled.title_regex);
+  }
+  return false;
+}
+
+void RuleSet::AddLiteral(const std::string& literal, uint32_t rule)
+{
+  int32_t state = 0;
+  for (const char ch : literal)
+  {
+    const unsigned char c = ch;
+    std::vector<std::pair<unsigned char, int32_t>>& next = states_[state].next;
+    auto i = std::lower_bound(next.begin(), next.end(), std::make_pair(c, int32_t(-1)));
+    if (i != next.end() && i->first == c)
+    {
+      state = i->second;
+      continue;
+    }
+    const int32_t created = states_.size();
+    next.insert(i, std::make_pair(c, created));
+    // invalidates next
+    states_.emplace_back();
+    state = created;
+  }
+  states_[state].rules.push_back(rule);
+}
+
+void RuleSet::BuildAutomaton()
+{
+  // breadth first, so fail targets are done before the states using them
+  std::deque<int32_t> queue;
+  for (const auto& edge : states_[0].next)
+  {
+    states_[edge.second].fail = 0;
+    queue.push_back(edge.second);
+  }
+  while (!queue.empty())
+  {
+    const int32_t state = queue.front();
+    queue.pop_front();
+    for (const auto& edge : states_[state].next)
+    {
+      int32_t fail = states_[state].fail;
+      while (fail != 0 && Next(fail, edge.first) < 0)
+      {
+        fail = states_[fail].fail;
+      }
+      const int32_t target = Next(fail, edge.first);
+      State& child = states_[edge.second];
+      child.fail = target >= 0 && target != edge.second ? target : 0;
+      child.output = states_[child.fail].rules.empty() ? states_[child.fail].output : child.fail;
+      queue.push_back(edge.second);
+    }
+  }
+}
+
+int32_t RuleSet::Next(int32_t state, unsigned char c) const
+{
+  const std::vector<std::pair<unsigned char, int32_t>>& next = states_[state].next;
+  auto i = std::lower_bound(next.begin(), next.end(), std::make_pair(c, int32_t(-1)));
+  return i != next.end() && i->first == c ? i->second : -1;
+}
+
+void RuleSet::ScanTitle(const std::string& title, std::vector<uint32_t>* candidates) const
+{
+  if (states_.size() == 1)
+  {
+    return;
+  }
+  int32_t state = 0;
+  for (const char ch : title)
+  {
+    const unsigned char c = ch;
+    int32_t next;
+    while ((next = Next(state, c)) < 0 && state != 0)
+    {
+      state = states_[state].fail;
+    }
+    state = next < 0 ? 0 : next;
+    for (int32_t s = states_[state].rules.empty() ? states_[state].output : state; s >= 0; s = states_[s].output)
+    {
+      candidates->insert(candidates->end(), states_[s].rules.begin(), states_[s].rules.end());
+    }
+  }
+}
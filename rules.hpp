@@ -0,0 +1,143 @@
+#ifndef RULES_HPP
+#define RULES_HPP
+
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What a rule does to a matching window.  Unset fields leave the window
+// alone, when several rules match the later ones win.
+struct RuleActions
+{
+  enum Layout
+  {
+    LAYOUT_UNSET,
+    LAYOUT_FLOATING,
+    LAYOUT_TILING,
+  };
+
+  // -1 if unset
+  int workspace = -1;
+  Layout layout = LAYOUT_UNSET;
+  // initial client size, 0 if unset
+  int width = 0;
+  int height = 0;
+  // never given the input focus
+  bool no_focus = false;
+  // left out of alt+tab
+  bool skip_alt_tab = false;
+
+  // Applies the fields other sets on top of these
+  void Merge(const RuleActions& other);
+};
+
+// Per application settings, matched when a window is mapped
+struct Rule
+{
+  // exact matches against WM_CLASS and WM_WINDOW_ROLE, empty matches any
+  std::string wm_class;
+  std::string instance;
+  std::string role;
+  // glob with * and ?, or a regex between slashes like "/^Save .*$/".
+  // Empty matches any.
+  std::string title;
+
+  RuleActions actions;
+};
+
+// What rules are matched against, fetched while framing
+struct WindowProperties
+{
+  std::string wm_class;
+  std::string instance;
+  std::string role;
+  std::string title;
+};
+
+// Evaluation time counters of RuleSet::Match()
+struct RuleStats
+{
+  uint64_t evaluations = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+
+  void Add(uint64_t ns);
+  std::string ToString() const;
+};
+
+// A rule list compiled for matching.  Rules are bucketed by their most
+// selective exact field (class, then instance, then role) in hash tables,
+// title-only glob rules share one Aho-Corasick automaton over the longest
+// literal of each glob, so a match only looks at the rules that can apply.
+// Regexes are compiled once, here.
+class RuleSet
+{
+  public:
+    // nullptr and error set if a regex doesn't compile
+    static std::shared_ptr<const RuleSet> Compile(const std::vector<Rule>& rules, std::string* error);
+
+    // Merged actions of every rule matching properties
+    RuleActions Match(const WindowProperties& properties) const;
+
+    bool empty() const { return rules_.empty(); }
+    size_t size() const { return rules_.size(); }
+
+    // Whether any rule looks at WM_CLASS (class or instance), the role or
+    // the title, properties no rule uses needn't be fetched
+    bool uses_class() const { return uses_class_; }
+    bool uses_role() const { return uses_role_; }
+    bool uses_title() const { return uses_title_; }
+
+  private:
+    enum TitleMatch
+    {
+      TITLE_ANY,
+      TITLE_GLOB,
+      TITLE_REGEX,
+    };
+
+    struct CompiledRule
+    {
+      Rule rule;
+      TitleMatch title_match;
+      std::regex title_regex;
+    };
+
+    // Aho-Corasick automaton over the literals of title globs
+    struct State
+    {
+      // sorted by byte
+      std::vector<std::pair<unsigned char, int32_t>> next;
+      int32_t fail = 0;
+      // closest state on the fail chain with rules, -1 if none
+      int32_t output = -1;
+      std::vector<uint32_t> rules;
+    };
+
+    RuleSet() = default;
+
+    bool Matches(const CompiledRule& compiled, const WindowProperties& properties) const;
+
+    void AddLiteral(const std::string& literal, uint32_t rule);
+    void BuildAutomaton();
+    int32_t Next(int32_t state, unsigned char c) const;
+    // rules whose literal occurs in title
+    void ScanTitle(const std::string& title, std::vector<uint32_t>* candidates) const;
+
+    std::vector<CompiledRule> rules_;
+    std::unordered_map<std::string, std::vector<uint32_t>> by_class_;
+    std::unordered_map<std::string, std::vector<uint32_t>> by_instance_;
+    std::unordered_map<std::string, std::vector<uint32_t>> by_role_;
+    // neither keyed nor covered by the automaton, checked every time
+    std::vector<uint32_t> unkeyed_;
+    std::vector<State> states_;
+
+    bool uses_class_ = false;
+    bool uses_role_ = false;
+    bool uses_title_ = false;
+};
+
+#endif // RULES_HPP
@@ -0,0 +1,77 @@
+#ifndef SHARED_STATE_HPP
+#define SHARED_STATE_HPP
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <string>
+
+// Layout of the POSIX shared memory segment the window manager publishes
+// its state in, see StateExport (writer) and StateReader (readers).  Shared
+// between processes, so only fixed size types and no pointers.  Bump
+// SHARED_STATE_VERSION on any change.
+
+const uint32_t SHARED_STATE_MAGIC = 0x574d3930;  // "WM90"
+const uint32_t SHARED_STATE_VERSION = 1;
+
+// clients beyond this are left out, see SharedState::truncated
+const uint32_t SHARED_STATE_MAX_CLIENTS = 1024;
+
+// SharedClient::flags
+const uint32_t SHARED_CLIENT_UNRESPONSIVE = 1 << 0;
+
+struct SharedClient
+{
+  uint64_t window;
+  // window itself when frameless
+  uint64_t frame;
+  // outer frame geometry, borders included
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+  // -1 if no rule placed it
+  int32_t workspace;
+  uint32_t flags;
+};
+
+// Guarded by a seqlock: the writer makes sequence odd, updates everything
+// after it and makes it even again.  A copy taken between two loads of the
+// same even sequence is consistent.
+struct SharedState
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  // set when the window manager exits, readers should reopen
+  std::atomic<uint32_t> closed;
+
+  std::atomic<uint32_t> sequence;
+  uint32_t num_clients;
+  // clients that didn't fit into capacity
+  uint32_t truncated;
+  uint32_t reserved;
+  // number of published updates
+  uint64_t updates;
+  // focused client, 0 if none
+  uint64_t focused;
+
+  // mapping order isn't kept, removals move the last client into the gap
+  SharedClient clients[SHARED_STATE_MAX_CLIENTS];
+};
+
+static_assert(sizeof(SharedClient) == 40, "SharedClient layout changed");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "seqlock needs a plain 32 bit atomic");
+
+// Name of the segment for display, e.g. /windowmaker9000-_0 for ":0"
+inline std::string SharedStateName(const std::string& display)
+{
+  std::string name = "/windowmaker9000-";
+  for (const char c : display)
+  {
+    name += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  return name;
+}
+
+#endif // SHARED_STATE_HPP
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <limits>
+#include "snap.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  // edges are padded to a multiple of this so the kernel needs no tail loop
+  const size_t LANES = 4;
+
+  const int32_t SPAN_MIN = std::numeric_limits<int32_t>::min();
+  const int32_t SPAN_MAX = std::numeric_limits<int32_t>::max();
+
+#ifdef __SSE2__
+  inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+  {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+  }
+
+  // SSE2 has no _mm_abs_epi32
+  inline __m128i Abs(__m128i v)
+  {
+    const __m128i sign = _mm_srai_epi32(v, 31);
+    return _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+  }
+#endif
+}
+
+void EdgeStore::Clear()
+{
+  vertical_.Clear();
+  horizontal_.Clear();
+}
+
+void EdgeStore::AddRect(const Rect<int>& rect)
+{
+  vertical_.Add(rect.left(), rect.top(), rect.bottom());
+  vertical_.Add(rect.right(), rect.top(), rect.bottom());
+  horizontal_.Add(rect.top(), rect.left(), rect.right());
+  horizontal_.Add(rect.bottom(), rect.left(), rect.right());
+}
+
+void EdgeStore::AddVerticalEdge(int x)
+{
+  vertical_.Add(x, SPAN_MIN, SPAN_MAX);
+}
+
+void EdgeStore::AddHorizontalEdge(int y)
+{
+  horizontal_.Add(y, SPAN_MIN, SPAN_MAX);
+}
+
+bool EdgeStore::NearestVertical(int x0, int x1, int span_begin, int span_end, int max_distance, int* delta) const
+{
+  return vertical_.Nearest(x0, x1, span_begin, span_end, max_distance, delta);
+}
+
+bool EdgeStore::NearestHorizontal(int y0, int y1, int span_begin, int span_end, int max_distance, int* delta) const
+{
+  return horizontal_.Nearest(y0, y1, span_begin, span_end, max_distance, delta);
+}
+
+void EdgeStore::Sort()
+{
+  vertical_.Sort();
+  horizontal_.Sort();
+}
+
+void EdgeStore::EdgeArray::Clear()
+{
+  pos.clear();
+  span_begin.clear();
+  span_end.clear();
+  count = 0;
+}
+
+void EdgeStore::EdgeArray::Add(int32_t p, int32_t begin, int32_t end)
+{
+  if (count == pos.size())
+  {
+    // padding never overlaps any span and stays behind every real edge
+    pos.resize(count + LANES, SPAN_MAX);
+    span_begin.resize(count + LANES, SPAN_MAX);
+    span_end.resize(count + LANES, SPAN_MIN);
+  }
+  pos[count] = p;
+  span_begin[count] = begin;
+  span_end[count] = end;
+  ++count;
+}
+
+void EdgeStore::EdgeArray::Sort()
+{
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [this] (size_t a, size_t b) { return pos[a] < pos[b]; });
+
+  std::vector<int32_t> sorted_pos(pos);
+  std::vector<int32_t> sorted_begin(span_begin);
+  std::vector<int32_t> sorted_end(span_end);
+  for (size_t i = 0; i < count; ++i)
+  {
+    sorted_pos[i] = pos[order[i]];
+    sorted_begin[i] = span_begin[order[i]];
+    sorted_end[i] = span_end[order[i]];
+  }
+  pos.swap(sorted_pos);
+  span_begin.swap(sorted_begin);
+  span_end.swap(sorted_end);
+}
+
+bool EdgeStore::EdgeArray::Nearest(int c0, int c1, int begin, int end, int max_distance, int* delta) const
+{
+  int32_t best_distance = max_distance + 1;
+  int32_t best_delta = 0;
+
+  const int candidates[] = { c0, c1 };
+  const int num_candidates = c0 == c1 ? 1 : 2;
+  for (int i = 0; i < num_candidates; ++i)
+  {
+    const int c = candidates[i];
+    // only edges within max_distance can win
+    const auto first = std::lower_bound(pos.cbegin(), pos.cbegin() + count, c - max_distance);
+    const auto last = std::upper_bound(first, pos.cbegin() + count, c + max_distance);
+    if (first == last)
+    {
+      continue;
+    }
+    // widen to whole vectors, the extra edges are out of range anyway
+    const size_t scan_first = (first - pos.cbegin()) & ~(LANES - 1);
+    const size_t scan_last = std::min(pos.size(), ((last - pos.cbegin()) + LANES - 1) & ~(LANES - 1));
+    Scan(scan_first, scan_last, c, begin, end, &best_distance, &best_delta);
+  }
+
+  if (best_distance > max_distance)
+  {
+    return false;
+  }
+  *delta = best_delta;
+  return true;
+}
+
+void EdgeStore::EdgeArray::Scan(size_t first, size_t last, int c, int begin, int end,
+                                int32_t* best_distance, int32_t* best_delta) const
+{
+#ifdef __SSE2__
+  const __m128i vc = _mm_set1_epi32(c);
+  const __m128i vbegin = _mm_set1_epi32(begin);
+  const __m128i vend = _mm_set1_epi32(end);
+  __m128i vbest_distance = _mm_set1_epi32(*best_distance);
+  __m128i vbest_delta = _mm_set1_epi32(*best_delta);
+
+  for (size_t i = first; i < last; i += LANES)
+  {
+    const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pos[i]));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&span_begin[i]));
+    const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&span_end[i]));
+
+    const __m128i overlap = _mm_and_si128(_mm_cmplt_epi32(b, vend), _mm_cmpgt_epi32(e, vbegin));
+    const __m128i d = _mm_sub_epi32(p, vc);
+    const __m128i a = Abs(d);
+
+    const __m128i better = _mm_and_si128(overlap, _mm_cmplt_epi32(a, vbest_distance));
+    vbest_distance = Select(better, a, vbest_distance);
+    vbest_delta = Select(better, d, vbest_delta);
+  }
+
+  alignas(16) int32_t lane_distance[LANES];
+  alignas(16) int32_t lane_delta[LANES];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lane_distance), vbest_distance);
+  _mm_store_si128(reinterpret_cast<__m128i*>(lane_delta), vbest_delta);
+  for (size_t lane = 0; lane < LANES; ++lane)
+  {
+    if (lane_distance[lane] < *best_distance)
+    {
+      *best_distance = lane_distance[lane];
+      *best_delta = lane_delta[lane];
+    }
+  }
+#else
+  for (size_t i = first; i < last; ++i)
+  {
+    if (span_begin[i] >= end || span_end[i] <= begin)
+    {
+      continue;
+    }
+    const int32_t d = pos[i] - c;
+    const int32_t a = d < 0 ? -d : d;
+    if (a < *best_distance)
+    {
+      *best_distance = a;
+      *best_delta = d;
+    }
+  }
+#endif
+}
+
+Rect<int> Snapper::SnapMove(const Rect<int>& rect) const
+{
+  Rect<int> snapped = rect;
+  int delta;
+  if (edges_.NearestVertical(rect.left(), rect.right(), rect.top(), rect.bottom(), distance_, &delta))
+  {
+    snapped.x += delta;
+  }
+  if (edges_.NearestHorizontal(rect.top(), rect.bottom(), rect.left(), rect.right(), distance_, &delta))
+  {
+    snapped.y += delta;
+  }
+  return snapped;
+}
+
+Rect<int> Snapper::SnapResize(const Rect<int>& rect) const
+{
+  Rect<int> snapped = rect;
+  int delta;
+  if (edges_.NearestVertical(rect.right(), rect.right(), rect.top(), rect.bottom(), distance_, &delta))
+  {
+    snapped.width = std::max(1, snapped.width + delta);
+  }
+  if (edges_.NearestHorizontal(rect.bottom(), rect.bottom(), rect.left(), rect.right(), distance_, &delta))
+  {
+    snapped.height = std::max(1, snapped.height + delta);
+  }
+  return snapped;
+}
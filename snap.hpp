@@ -0,0 +1,85 @@
+#ifndef SNAP_HPP
+#define SNAP_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "util.hpp"
+
+// Window and screen edges a dragged window can snap to.
+//
+// Each axis is stored as structure of arrays (edge position plus the span it
+// covers on the other axis), sorted by position.  A query binary searches the
+// positions within snapping distance and runs a SIMD scan over just that
+// slice to find the closest edge whose span overlaps the dragged window.
+// Built once when a drag starts, queried on every motion tick.
+class EdgeStore
+{
+  public:
+    void Clear();
+
+    // Adds all four edges of rect
+    void AddRect(const Rect<int>& rect);
+
+    // Adds edges that span the whole other axis, e.g. the screen border
+    void AddVerticalEdge(int x);
+    void AddHorizontalEdge(int y);
+
+    // Must be called after adding edges and before querying
+    void Sort();
+
+    // Nearest vertical edge to either candidate x position among the edges
+    // whose span overlaps [span_begin, span_end).  On success stores the
+    // offset that moves the closer candidate onto the edge in delta.
+    bool NearestVertical(int x0, int x1, int span_begin, int span_end, int max_distance, int* delta) const;
+    // Same for horizontal edges and y positions
+    bool NearestHorizontal(int y0, int y1, int span_begin, int span_end, int max_distance, int* delta) const;
+
+    size_t size() const { return vertical_.count + horizontal_.count; }
+
+  private:
+    struct EdgeArray
+    {
+      // padded to a multiple of the vector width with edges that overlap
+      // nothing and sort last
+      std::vector<int32_t> pos;
+      std::vector<int32_t> span_begin;
+      std::vector<int32_t> span_end;
+      size_t count = 0;
+
+      void Clear();
+      void Add(int32_t p, int32_t begin, int32_t end);
+      void Sort();
+      bool Nearest(int c0, int c1, int begin, int end, int max_distance, int* delta) const;
+
+      // the kernel, narrows best_distance/best_delta over [first, last)
+      void Scan(size_t first, size_t last, int c, int begin, int end,
+                int32_t* best_distance, int32_t* best_delta) const;
+    };
+
+    EdgeArray vertical_;
+    EdgeArray horizontal_;
+};
+
+// Snaps dragged frames to the edges in an EdgeStore
+class Snapper
+{
+  public:
+    explicit Snapper(int distance) : distance_(distance) { }
+
+    EdgeStore& edges() { return edges_; }
+
+    void set_distance(int distance) { distance_ = distance; }
+
+    // Moves rect so that its closest edge on each axis sits on a nearby edge
+    Rect<int> SnapMove(const Rect<int>& rect) const;
+
+    // Resizes rect so that its right and bottom edges sit on nearby edges
+    Rect<int> SnapResize(const Rect<int>& rect) const;
+
+  private:
+    int distance_;
+    EdgeStore edges_;
+};
+
+#endif // SNAP_HPP
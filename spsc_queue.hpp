@@ -0,0 +1,77 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread.  Each side keeps a cached copy of the other side's index
+// and only reloads it when the queue looks full or empty, so in the common
+// case a push or pop touches no cache line the other thread writes.
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+  static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+  public:
+    SpscQueue()
+        : head_(0),
+          tail_cache_(0),
+          tail_(0),
+          head_cache_(0)
+    {
+    }
+
+    // Producer, false if the queue is full
+    bool TryPush(T value)
+    {
+      const size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_cache_ == CAPACITY)
+      {
+        head_cache_ = head_.load(std::memory_order_acquire);
+        if (tail - head_cache_ == CAPACITY)
+        {
+          return false;
+        }
+      }
+      items_[tail & (CAPACITY - 1)] = std::move(value);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer, false if the queue is empty
+    bool TryPop(T* value)
+    {
+      const size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_cache_)
+      {
+        tail_cache_ = tail_.load(std::memory_order_acquire);
+        if (head == tail_cache_)
+        {
+          return false;
+        }
+      }
+      *value = std::move(items_[head & (CAPACITY - 1)]);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    // alignas() on members would need aligned new, padding does the same
+    static const size_t CACHE_LINE = 64;
+
+    // consumer side
+    std::atomic<size_t> head_;
+    size_t tail_cache_;
+    char consumer_padding_[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    // producer side
+    std::atomic<size_t> tail_;
+    size_t head_cache_;
+    char producer_padding_[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    T items_[CAPACITY];
+};
+
+#endif // SPSC_QUEUE_HPP
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "state_export.hpp"
+
+std::unique_ptr<StateExport> StateExport::Create(const std::string& name)
+{
+  // no O_TRUNC: a segment left behind by a crashed instance may still be
+  // mapped by readers, which would fault on a truncated mapping
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    PLOG(ERROR) << "shm_open " << name;
+    return nullptr;
+  }
+  void* mapping = MAP_FAILED;
+  if (ftruncate(fd, sizeof(SharedState)) == 0)
+  {
+    mapping = mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (mapping == MAP_FAILED)
+  {
+    PLOG(ERROR) << "mapping " << name;
+    close(fd);
+    return nullptr;
+  }
+  // the mapping stays valid without it
+  close(fd);
+
+  // a new segment is all zeros, an old one is reset under the seqlock so its
+  // readers see an empty client list instead of a torn one.  A writer that
+  // died mid update left the sequence odd already.
+  SharedState* shared = static_cast<SharedState*>(mapping);
+  const uint32_t sequence = shared->sequence.load(std::memory_order_relaxed) | 1;
+  shared->sequence.store(sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  shared->magic = SHARED_STATE_MAGIC;
+  shared->version = SHARED_STATE_VERSION;
+  shared->capacity = SHARED_STATE_MAX_CLIENTS;
+  shared->num_clients = 0;
+  shared->truncated = 0;
+  shared->reserved = 0;
+  shared->updates = 0;
+  shared->focused = None;
+  shared->closed.store(0, std::memory_order_relaxed);
+
+  shared->sequence.store(sequence + 1, std::memory_order_release);
+  LOG(INFO) << "Exporting state to " << name;
+  return std::unique_ptr<StateExport>(new StateExport(name, shared));
+}
+
+StateExport::StateExport(const std::string& name, SharedState* shared)
+    : name_(name),
+      shared_(shared),
+      focused_(None),
+      dirty_(false)
+{
+}
+
+StateExport::~StateExport()
+{
+  shared_->closed.store(1, std::memory_order_release);
+  munmap(shared_, sizeof(SharedState));
+  shm_unlink(name_.c_str());
+}
+
+void StateExport::AddClient(Window win, Window frame, const Rect<int>& geometry, int workspace)
+{
+  if (frames_.count(win))
+  {
+    RemoveClient(win);
+  }
+  SharedClient client;
+  std::memset(&client, 0, sizeof(client));
+  client.window = win;
+  client.frame = frame;
+  client.workspace = workspace;
+  slots_[frame] = clients_.size();
+  frames_[win] = frame;
+  clients_.push_back(client);
+  SetGeometry(frame, geometry);
+  dirty_ = true;
+}
+
+void StateExport::RemoveClient(Window win)
+{
+  auto frame = frames_.find(win);
+  if (frame == frames_.end())
+  {
+    return;
+  }
+  auto slot = slots_.find(frame->second);
+  const size_t index = slot->second;
+  slots_.erase(slot);
+  frames_.erase(frame);
+
+  // O(1), the last client moves into the gap
+  if (index + 1 != clients_.size())
+  {
+    clients_[index] = clients_.back();
+    slots_[clients_[index].frame] = index;
+  }
+  clients_.pop_back();
+  if (focused_ == win)
+  {
+    focused_ = None;
+  }
+  dirty_ = true;
+}
+
+void StateExport::SetGeometry(Window frame, const Rect<int>& geometry)
+{
+  SharedClient* client = Find(frame);
+  if (client == nullptr)
+  {
+    return;
+  }
+  client->x = geometry.x;
+  client->y = geometry.y;
+  client->width = geometry.width;
+  client->height = geometry.height;
+  dirty_ = true;
+}
+
+void StateExport::SetFocus(Window win)
+{
+  if (focused_ != win)
+  {
+    focused_ = win;
+    dirty_ = true;
+  }
+}
+
+void StateExport::SetUnresponsive(Window win, bool unresponsive)
+{
+  auto frame = frames_.find(win);
+  if (frame == frames_.end())
+  {
+    return;
+  }
+  SharedClient* client = Find(frame->second);
+  if (client == nullptr)
+  {
+    return;
+  }
+  if (unresponsive)
+  {
+    client->flags |= SHARED_CLIENT_UNRESPONSIVE;
+  }
+  else
+  {
+    client->flags &= ~SHARED_CLIENT_UNRESPONSIVE;
+  }
+  dirty_ = true;
+}
+
+void StateExport::Publish()
+{
+  if (!dirty_)
+  {
+    return;
+  }
+  dirty_ = false;
+
+  const uint32_t count = std::min<size_t>(clients_.size(), SHARED_STATE_MAX_CLIENTS);
+  const uint32_t sequence = shared_->sequence.load(std::memory_order_relaxed);
+  // odd while writing, the fence keeps the data stores after it
+  shared_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  shared_->num_clients = count;
+  shared_->truncated = clients_.size() - count;
+  ++shared_->updates;
+  shared_->focused = focused_;
+  std::memcpy(shared_->clients, clients_.data(), count * sizeof(SharedClient));
+
+  shared_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+SharedClient* StateExport::Find(Window frame)
+{
+  auto slot = slots_.find(frame);
+  return slot == slots_.end() ? nullptr : &clients_[slot->second];
+}
@@ -0,0 +1,68 @@
+#ifndef STATE_EXPORT_HPP
+#define STATE_EXPORT_HPP
+
+extern "C"
+{
+#include <X11/Xlib.h>
+}
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shared_state.hpp"
+#include "util.hpp"
+
+// Publishes the client list, geometry, focus and workspaces into a POSIX
+// shared memory segment (see SharedState), so status bars and monitors can
+// read them without a single request to the X server.  Opt-in through
+// Config::export_state.
+//
+// Like Ewmh, handlers only record changes in a private copy; Publish() is
+// called once per event loop iteration and copies it into the segment under
+// the seqlock if anything changed.
+class StateExport
+{
+  public:
+    // Creates the segment name or takes over and resets an existing one,
+    // nullptr on failure.  Only call it once this process owns the display,
+    // the destructor unlinks the name.
+    static std::unique_ptr<StateExport> Create(const std::string& name);
+
+    // Marks the segment closed and unlinks it
+    ~StateExport();
+
+    // Bookkeeping, called from Frame()/Unframe(), configure and focus
+    // changes.  Frames are the key of geometry updates, clients of the rest.
+    void AddClient(Window win, Window frame, const Rect<int>& geometry, int workspace);
+    void RemoveClient(Window win);
+    void SetGeometry(Window frame, const Rect<int>& geometry);
+    void SetFocus(Window win);
+    void SetUnresponsive(Window win, bool unresponsive);
+
+    // Writes all pending changes
+    void Publish();
+
+    const std::string& name() const { return name_; }
+
+  private:
+    // Invoked by Create()
+    StateExport(const std::string& name, SharedState* shared);
+
+    // the client of frame, nullptr if unknown
+    SharedClient* Find(Window frame);
+
+    const std::string name_;
+    // the mapped segment
+    SharedState* const shared_;
+
+    // what the next Publish() writes
+    std::vector<SharedClient> clients_;
+    // index into clients_ by frame, and frame by client
+    std::unordered_map<Window, size_t> slots_;
+    std::unordered_map<Window, Window> frames_;
+    Window focused_;
+    bool dirty_;
+};
+
+#endif // STATE_EXPORT_HPP
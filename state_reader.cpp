@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "state_reader.hpp"
+
+std::unique_ptr<StateReader> StateReader::Open(const std::string& display)
+{
+  const char* display_env = std::getenv("DISPLAY");
+  const std::string name = SharedStateName(display.empty() && display_env ? display_env : display);
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, sizeof(SharedState), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    return nullptr;
+  }
+  const SharedState* shared = static_cast<const SharedState*>(mapping);
+  if (shared->magic != SHARED_STATE_MAGIC ||
+      shared->version != SHARED_STATE_VERSION ||
+      shared->capacity != SHARED_STATE_MAX_CLIENTS)
+  {
+    munmap(mapping, sizeof(SharedState));
+    return nullptr;
+  }
+  return std::unique_ptr<StateReader>(new StateReader(shared));
+}
+
+StateReader::StateReader(const SharedState* shared)
+    : shared_(shared)
+{
+}
+
+StateReader::~StateReader()
+{
+  munmap(const_cast<SharedState*>(shared_), sizeof(SharedState));
+}
+
+bool StateReader::Read(StateSnapshot* snapshot, int max_attempts) const
+{
+  snapshot->clients.reserve(SHARED_STATE_MAX_CLIENTS);
+  for (int attempt = 0; attempt < max_attempts; ++attempt)
+  {
+    const uint32_t sequence = shared_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+    {
+      // mid update
+      continue;
+    }
+
+    // may be torn, only trusted once the sequence is confirmed below
+    const uint32_t count = std::min(shared_->num_clients, SHARED_STATE_MAX_CLIENTS);
+    snapshot->clients.resize(count);
+    std::memcpy(snapshot->clients.data(), shared_->clients, count * sizeof(SharedClient));
+    snapshot->updates = shared_->updates;
+    snapshot->focused = shared_->focused;
+    snapshot->truncated = shared_->truncated;
+
+    // the copy's loads stay before the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shared_->sequence.load(std::memory_order_relaxed) == sequence)
+    {
+      snapshot->sequence = sequence;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StateReader::Changed(const StateSnapshot& snapshot) const
+{
+  return shared_->sequence.load(std::memory_order_acquire) != snapshot.sequence;
+}
+
+bool StateReader::closed() const
+{
+  return shared_->closed.load(std::memory_order_acquire) != 0;
+}
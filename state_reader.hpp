@@ -0,0 +1,58 @@
+#ifndef STATE_READER_HPP
+#define STATE_READER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_state.hpp"
+
+// Consistent copy of the window manager's state
+struct StateSnapshot
+{
+  // seqlock sequence the copy was taken at
+  uint32_t sequence = 0;
+  uint64_t updates = 0;
+  uint64_t focused = 0;
+  uint32_t truncated = 0;
+  std::vector<SharedClient> clients;
+};
+
+// Reader side of StateExport, for status bars and monitors.  Link
+// state_reader.cpp and include this header only, nothing X is needed.
+//
+//   std::unique_ptr<StateReader> reader = StateReader::Open(":0");
+//   StateSnapshot snapshot;
+//   if (reader && reader->Read(&snapshot)) ...
+//
+// Read() is a couple of loads and a memcpy out of the mapped segment: no
+// syscalls, no X requests and, once snapshot.clients has grown to fit, no
+// allocations.
+class StateReader
+{
+  public:
+    // Maps the segment of display, or $DISPLAY if empty.  nullptr if the
+    // window manager doesn't export its state, or exports another version.
+    static std::unique_ptr<StateReader> Open(const std::string& display = std::string());
+
+    ~StateReader();
+
+    // Copies the current state into snapshot.  Gives up and returns false
+    // if every one of max_attempts attempts overlapped an update.
+    bool Read(StateSnapshot* snapshot, int max_attempts = 1000) const;
+
+    // Whether anything was published since snapshot was read, a single load
+    bool Changed(const StateSnapshot& snapshot) const;
+
+    // The window manager exited, Open() again to follow its successor
+    bool closed() const;
+
+  private:
+    // Invoked by Open()
+    explicit StateReader(const SharedState* shared);
+
+    const SharedState* const shared_;
+};
+
+#endif // STATE_READER_HPP
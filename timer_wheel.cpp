@@ -0,0 +1,213 @@
+#include <algorithm>
+#include "timer_wheel.hpp"
+
+const int TimerWheel::LEVELS;
+const int TimerWheel::SLOT_BITS;
+const int TimerWheel::SLOTS;
+
+TimerWheel::TimerWheel(uint64_t now)
+    : now_(now),
+      size_(0),
+      free_(-1),
+      slots_(LEVELS * SLOTS, -1)
+{
+  for (int level = 0; level < LEVELS; ++level)
+  {
+    occupied_[level] = 0;
+  }
+}
+
+TimerId TimerWheel::Schedule(uint64_t delay, Callback callback)
+{
+  return ScheduleAt(now_ + delay, std::move(callback));
+}
+
+TimerId TimerWheel::ScheduleAt(uint64_t expiry, Callback callback)
+{
+  int32_t index = free_;
+  if (index >= 0)
+  {
+    free_ = nodes_[index].next;
+  }
+  else
+  {
+    index = nodes_.size();
+    nodes_.emplace_back();
+  }
+
+  Node& node = nodes_[index];
+  node.expiry = expiry;
+  node.callback = std::move(callback);
+  Insert(index);
+  ++size_;
+  return (static_cast<TimerId>(node.generation) << 32) | static_cast<uint32_t>(index + 1);
+}
+
+bool TimerWheel::Cancel(TimerId id)
+{
+  const int64_t index = static_cast<int64_t>(id & 0xffffffff) - 1;
+  if (index < 0 || index >= static_cast<int64_t>(nodes_.size()))
+  {
+    return false;
+  }
+  const Node& node = nodes_[index];
+  if (node.bucket < 0 || node.generation != static_cast<uint32_t>(id >> 32))
+  {
+    return false;
+  }
+  Unlink(index);
+  Release(index);
+  return true;
+}
+
+size_t TimerWheel::Advance(uint64_t now)
+{
+  size_t ran = 0;
+  while (size_ > 0)
+  {
+    const uint64_t next = NextExpiry();
+    if (next > now)
+    {
+      break;
+    }
+    now_ = next;
+
+    // higher levels first, a cascaded timer may be due right now
+    for (int level = LEVELS - 1; level > 0; --level)
+    {
+      const int slot = (now_ >> (level * SLOT_BITS)) & (SLOTS - 1);
+      if (occupied_[level] & (uint64_t(1) << slot))
+      {
+        Cascade(level);
+      }
+    }
+
+    // everything in the current level 0 slot expires exactly now
+    const int bucket = now_ & (SLOTS - 1);
+    while (slots_[bucket] >= 0)
+    {
+      const int32_t index = slots_[bucket];
+      Unlink(index);
+      Callback callback = std::move(nodes_[index].callback);
+      Release(index);
+      ++ran;
+      callback();
+    }
+  }
+  if (now > now_)
+  {
+    now_ = now;
+  }
+  return ran;
+}
+
+uint64_t TimerWheel::NextExpiry() const
+{
+  if (size_ == 0)
+  {
+    return 0;
+  }
+
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < LEVELS; ++level)
+  {
+    const int shift = level * SLOT_BITS;
+    const uint64_t current = now_ >> shift;
+    const int offset = FirstOccupied(occupied_[level], current & (SLOTS - 1));
+    if (offset < SLOTS)
+    {
+      // level 0 slots expire, higher level slots cascade at their start
+      next = std::min(next, (current + offset) << shift);
+    }
+  }
+  return next;
+}
+
+void TimerWheel::Insert(int32_t index)
+{
+  Node& node = nodes_[index];
+  const uint64_t expiry = std::max(node.expiry, now_);
+
+  // lowest level whose range reaches expiry
+  int level = 0;
+  uint64_t slot = expiry;
+  for (; level < LEVELS; ++level)
+  {
+    const int shift = level * SLOT_BITS;
+    if ((expiry >> shift) - (now_ >> shift) < SLOTS)
+    {
+      slot = expiry >> shift;
+      break;
+    }
+  }
+  if (level == LEVELS)
+  {
+    // beyond the wheel, park in the furthest slot and cascade again later
+    level = LEVELS - 1;
+    slot = (now_ >> (level * SLOT_BITS)) + SLOTS - 1;
+  }
+
+  const int bucket = level * SLOTS + (slot & (SLOTS - 1));
+  node.bucket = bucket;
+  node.prev = -1;
+  node.next = slots_[bucket];
+  if (node.next >= 0)
+  {
+    nodes_[node.next].prev = index;
+  }
+  slots_[bucket] = index;
+  occupied_[level] |= uint64_t(1) << (slot & (SLOTS - 1));
+}
+
+void TimerWheel::Unlink(int32_t index)
+{
+  Node& node = nodes_[index];
+  if (node.prev >= 0)
+  {
+    nodes_[node.prev].next = node.next;
+  }
+  else
+  {
+    slots_[node.bucket] = node.next;
+  }
+  if (node.next >= 0)
+  {
+    nodes_[node.next].prev = node.prev;
+  }
+  if (slots_[node.bucket] < 0)
+  {
+    occupied_[node.bucket / SLOTS] &= ~(uint64_t(1) << (node.bucket % SLOTS));
+  }
+  node.bucket = -1;
+}
+
+void TimerWheel::Release(int32_t index)
+{
+  Node& node = nodes_[index];
+  node.callback = nullptr;
+  ++node.generation;
+  node.next = free_;
+  free_ = index;
+  --size_;
+}
+
+void TimerWheel::Cascade(int level)
+{
+  const int slot = (now_ >> (level * SLOT_BITS)) & (SLOTS - 1);
+  const int bucket = level * SLOTS + slot;
+  int32_t index = slots_[bucket];
+  slots_[bucket] = -1;
+  occupied_[level] &= ~(uint64_t(1) << slot);
+  while (index >= 0)
+  {
+    const int32_t next = nodes_[index].next;
+    Insert(index);
+    index = next;
+  }
+}
+
+int TimerWheel::FirstOccupied(uint64_t occupied, int first)
+{
+  const uint64_t rotated = first == 0 ? occupied : (occupied >> first) | (occupied << (SLOTS - first));
+  return rotated == 0 ? SLOTS : __builtin_ctzll(rotated);
+}
@@ -0,0 +1,85 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Identifies a scheduled timer, 0 is never a valid id
+typedef uint64_t TimerId;
+
+// Hierarchical timer wheel with millisecond ticks.  Four levels of 64 slots
+// cover 64^4 ms (about 4.6 hours) directly, longer delays park in the top
+// level and are cascaded again.  Schedule() and Cancel() are O(1), timers
+// live in a slab and ids carry a generation so stale ids are harmless.
+//
+// The wheel has no clock of its own, the owner passes the current time to
+// Advance() and sleeps until NextExpiry().
+class TimerWheel
+{
+  public:
+    typedef std::function<void()> Callback;
+
+    explicit TimerWheel(uint64_t now);
+
+    // Runs callback once delay ms after the wheel's current time, which lags
+    // the real clock until the next Advance()
+    TimerId Schedule(uint64_t delay, Callback callback);
+    // Runs callback once at the absolute time expiry, right away on the next
+    // Advance() if that already passed
+    TimerId ScheduleAt(uint64_t expiry, Callback callback);
+
+    // Returns false if the timer already ran or was cancelled
+    bool Cancel(TimerId id);
+
+    // Moves the current time to now, running every timer due on the way in
+    // expiry order.  Callbacks may schedule and cancel timers.  Returns the
+    // number of callbacks run.
+    size_t Advance(uint64_t now);
+
+    // Earliest time Advance() has work to do, a timer or a cascade.  0 if no
+    // timer is scheduled.
+    uint64_t NextExpiry() const;
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return size_; }
+
+  private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    struct Node
+    {
+      uint64_t expiry = 0;
+      // bumped on every release, part of the id
+      uint32_t generation = 0;
+      // index into slots_, -1 when free
+      int bucket = -1;
+      // doubly linked within the slot, free list through next
+      int32_t prev = -1;
+      int32_t next = -1;
+      Callback callback;
+    };
+
+    // Links node into the slot matching its expiry relative to now_
+    void Insert(int32_t index);
+    void Unlink(int32_t index);
+    void Release(int32_t index);
+    // Re-inserts every timer of a higher level slot that now_ reached
+    void Cascade(int level);
+    // Offset of the first occupied slot at or after first, SLOTS if none
+    static int FirstOccupied(uint64_t occupied, int first);
+
+    uint64_t now_;
+    size_t size_;
+    std::vector<Node> nodes_;
+    int32_t free_;
+    // list heads, LEVELS * SLOTS
+    std::vector<int32_t> slots_;
+    // bit per non-empty slot for each level
+    uint64_t occupied_[LEVELS];
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Measures drag and alt+tab latency on a private Xvfb: runs the window
+# manager with the latency tracer on, drives it with xtest_drag and prints
+# the tracer's report.
+#
+#   WM=path/to/windowmaker9000 DRIVER=path/to/xtest_drag tools/latency.sh [xtest_drag options]
+set -e
+
+WM=${WM:-./windowmaker9000}
+DRIVER=${DRIVER:-./xtest_drag}
+XDISPLAY=${XDISPLAY:-:97}
+LOG=$(mktemp)
+
+Xvfb "$XDISPLAY" -screen 0 1920x1080x24 -nolisten tcp &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null; rm -f "$LOG"' EXIT
+sleep 1
+
+WM_TRACE_LATENCY=1 GLOG_logtostderr=1 "$WM" "$XDISPLAY" 2> "$LOG" &
+wm=$!
+sleep 1
+
+DISPLAY=$XDISPLAY "$DRIVER" "$@"
+
+# SIGINT makes it log the final report
+kill -INT $wm
+wait $wm || true
+sed -n '/Latency/,/unanswered/p' "$LOG" | tail -5
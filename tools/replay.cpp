@@ -0,0 +1,479 @@
+// Feeds XEvent streams through the window manager's handlers on top of
+// FakeBackend, no X server involved, and reports pure handler throughput.
+//
+//   replay [--clients N] [--rounds N] [--batch N] [--frameless] [--rules N]
+//          [--export-state] [recording]
+//
+// Without a recording a synthetic session is generated: every round maps N
+// clients (each with a few ConfigureRequests), alt-drags each of them,
+// alt-tabs through them and unmaps them again.  Events are queued --batch at
+// a time, so that is the batch size the event loop sees.  --frameless runs
+// the window manager with Config::frameless, for comparing the windows each
+// client costs and map cost against reparenting.  Windows are counted in the
+// fake's model; what they cost in server memory needs a real server.
+// --rules loads N synthetic window rules, a mix of class, instance, title
+// glob and title regex rules, and gives the clients matching WM_CLASS and
+// titles.  --export-state publishes the state in shared memory as
+// Config::export_state does, for its cost per event.
+//
+// A recording is the raw XEvent array written by XlibBackend::RecordEvents()
+// (WM_RECORD_EVENTS=path windowmaker9000).  It replays faithfully when it was
+// taken from window manager startup.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+}
+
+#include <glog/logging.h>
+#include "../config.hpp"
+#include "../fake_backend.hpp"
+#include "../state_reader.hpp"
+#include "../window_manager.hpp"
+
+namespace
+{
+  // counts heap allocations while the handlers run
+  bool counting_allocations = false;
+  uint64_t allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+  if (counting_allocations)
+  {
+    ++allocations;
+  }
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// out of line: inlined, GCC pairs the free() with the operator new call and
+// warns about mismatched allocation functions
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  struct Options
+  {
+    int clients = 100;
+    int rounds = 10;
+    size_t batch = 1;
+    bool frameless = false;
+    int rules = 0;
+    bool export_state = false;
+    std::string recording;
+  };
+
+  XEvent MakeEvent(int type)
+  {
+    XEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    return e;
+  }
+
+  // Synthetic session, generated phase by phase because unmaps have to name
+  // the frames the window manager created for the clients
+  class SyntheticSession
+  {
+    public:
+      SyntheticSession(FakeBackend* fake, int clients)
+          : fake_(fake),
+            clients_(clients),
+            time_(1)
+      {
+      }
+
+      void MapAll(std::vector<XEvent>* events)
+      {
+        windows_.clear();
+        for (int i = 0; i < clients_; ++i)
+        {
+          const int x = (i * 37) % 1600;
+          const int y = (i * 23) % 900;
+          const Window win = fake_->CreateClient(x, y, 300, 200);
+          windows_.push_back(win);
+          const std::string app = std::to_string(i % 64);
+          fake_->SetClientProperty(win, XA_WM_CLASS, "app" + app + '\0' + "App" + app + '\0');
+          fake_->SetClientProperty(win, XA_WM_NAME, "Document " + std::to_string(i) + " - App" + app);
+
+          XEvent e = MakeEvent(CreateNotify);
+          e.xcreatewindow.parent = fake_->Root();
+          e.xcreatewindow.window = win;
+          e.xcreatewindow.x = x;
+          e.xcreatewindow.y = y;
+          e.xcreatewindow.width = 300;
+          e.xcreatewindow.height = 200;
+          events->push_back(e);
+
+          // toolkits like to configure a couple of times before mapping
+          for (int j = 0; j < 3; ++j)
+          {
+            e = MakeEvent(ConfigureRequest);
+            e.xconfigurerequest.parent = fake_->Root();
+            e.xconfigurerequest.window = win;
+            e.xconfigurerequest.width = 300 + j * 10;
+            e.xconfigurerequest.height = 200 + j * 10;
+            e.xconfigurerequest.value_mask = CWWidth | CWHeight;
+            events->push_back(e);
+          }
+
+          e = MakeEvent(MapRequest);
+          e.xmaprequest.parent = fake_->Root();
+          e.xmaprequest.window = win;
+          events->push_back(e);
+        }
+      }
+
+      void Interact(std::vector<XEvent>* events)
+      {
+        const KeyCode tab = fake_->KeysymToKeycode(XK_Tab);
+        for (const Window win : windows_)
+        {
+          XEvent e = MakeEvent(ButtonPress);
+          e.xbutton.window = win;
+          e.xbutton.root = fake_->Root();
+          e.xbutton.button = Button1;
+          e.xbutton.state = Mod1Mask;
+          e.xbutton.x_root = 100;
+          e.xbutton.y_root = 100;
+          e.xbutton.time = time_++;
+          events->push_back(e);
+
+          for (int j = 1; j <= 10; ++j)
+          {
+            e = MakeEvent(MotionNotify);
+            e.xmotion.window = win;
+            e.xmotion.root = fake_->Root();
+            e.xmotion.state = Mod1Mask | Button1Mask;
+            e.xmotion.x_root = 100 + j * 3;
+            e.xmotion.y_root = 100 + j * 2;
+            e.xmotion.time = time_++;
+            events->push_back(e);
+          }
+
+          e = MakeEvent(ButtonRelease);
+          e.xbutton.window = win;
+          e.xbutton.root = fake_->Root();
+          e.xbutton.button = Button1;
+          e.xbutton.state = Mod1Mask | Button1Mask;
+          e.xbutton.time = time_++;
+          events->push_back(e);
+
+          e = MakeEvent(KeyPress);
+          e.xkey.window = win;
+          e.xkey.root = fake_->Root();
+          e.xkey.state = Mod1Mask;
+          e.xkey.keycode = tab;
+          e.xkey.time = time_++;
+          events->push_back(e);
+        }
+      }
+
+      void UnmapAll(std::vector<XEvent>* events)
+      {
+        for (const Window win : windows_)
+        {
+          const FakeBackend::FakeWindow* fake = fake_->window(win);
+          CHECK(fake);
+
+          // the frame selected SubstructureNotify, so that's where it's reported
+          XEvent e = MakeEvent(UnmapNotify);
+          e.xunmap.event = fake->parent;
+          e.xunmap.window = win;
+          events->push_back(e);
+
+          e = MakeEvent(DestroyNotify);
+          e.xdestroywindow.event = fake_->Root();
+          e.xdestroywindow.window = win;
+          events->push_back(e);
+        }
+      }
+
+      // client side cleanup once the window manager let go
+      void DestroyClients()
+      {
+        for (const Window win : windows_)
+        {
+          fake_->RemoveWindow(win);
+        }
+      }
+
+    private:
+      FakeBackend* fake_;
+      const int clients_;
+      Time time_;
+      std::vector<Window> windows_;
+  };
+
+  struct Totals
+  {
+    uint64_t events = 0;
+    uint64_t allocations = 0;
+    std::chrono::nanoseconds elapsed{0};
+  };
+
+  // Queues events batch at a time and lets the window manager process them
+  void Feed(WindowManager* wm, FakeBackend* fake, const std::vector<XEvent>& events, size_t batch, Totals* totals)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    allocations = 0;
+    counting_allocations = true;
+    for (size_t i = 0; i < events.size(); )
+    {
+      const size_t end = std::min(events.size(), i + batch);
+      for (; i < end; ++i)
+      {
+        fake->PushEvent(events[i]);
+      }
+      while (fake->EventsQueued() > 0)
+      {
+        wm->ProcessBatch();
+      }
+    }
+    counting_allocations = false;
+    totals->elapsed += std::chrono::steady_clock::now() - start;
+    totals->allocations += allocations;
+    totals->events += events.size();
+  }
+
+  // Every fourth rule of each kind, numbered so that some of them match the
+  // synthetic clients
+  std::vector<Rule> SyntheticRules(int count)
+  {
+    std::vector<Rule> rules(count);
+    for (int i = 0; i < count; ++i)
+    {
+      const std::string n = std::to_string(i);
+      switch (i % 4)
+      {
+        case 0:
+          rules[i].wm_class = "App" + n;
+          break;
+        case 1:
+          rules[i].instance = "app" + n;
+          break;
+        case 2:
+          rules[i].title = "Document " + n + " - *";
+          break;
+        case 3:
+          rules[i].title = "/^Document [0-9]+ - App" + n + "$/";
+          break;
+      }
+      rules[i].actions.workspace = i % 10;
+    }
+    return rules;
+  }
+
+  bool ReadRecording(const std::string& path, std::vector<XEvent>* events)
+  {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+      LOG(ERROR) << "Failed to open " << path;
+      return false;
+    }
+    XEvent e;
+    while (std::fread(&e, sizeof(e), 1, file) == 1)
+    {
+      events->push_back(e);
+    }
+    std::fclose(file);
+    return true;
+  }
+
+  // The recorded root is the parent named by the first top level request
+  Window RecordedRoot(const std::vector<XEvent>& events)
+  {
+    for (const XEvent& e : events)
+    {
+      if (e.type == MapRequest)
+      {
+        return e.xmaprequest.parent;
+      }
+      if (e.type == CreateNotify)
+      {
+        return e.xcreatewindow.parent;
+      }
+    }
+    return 1;
+  }
+
+  bool ParseOptions(int argc, char** argv, Options* options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--clients" && i + 1 < argc)
+      {
+        options->clients = std::atoi(argv[++i]);
+      }
+      else if (arg == "--rounds" && i + 1 < argc)
+      {
+        options->rounds = std::atoi(argv[++i]);
+      }
+      else if (arg == "--batch" && i + 1 < argc)
+      {
+        options->batch = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--rules" && i + 1 < argc)
+      {
+        options->rules = std::atoi(argv[++i]);
+      }
+      else if (arg == "--frameless")
+      {
+        options->frameless = true;
+      }
+      else if (arg == "--export-state")
+      {
+        options->export_state = true;
+      }
+      else if (!arg.empty() && arg[0] != '-')
+      {
+        options->recording = arg;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+  // handler throughput, not logging throughput
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--clients N] [--rounds N] [--batch N] [--frameless] [--rules N] [--export-state] [recording]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<XEvent> recording;
+  if (!options.recording.empty() && !ReadRecording(options.recording, &recording))
+  {
+    return EXIT_FAILURE;
+  }
+
+  FakeBackend* fake = new FakeBackend(1920, 1080, recording.empty() ? 1 : RecordedRoot(recording));
+  std::shared_ptr<Config> config = std::make_shared<Config>(*DefaultConfig());
+  config->frameless = options.frameless;
+  config->export_state = options.export_state;
+  std::string error;
+  config->rules = RuleSet::Compile(SyntheticRules(options.rules), &error);
+  CHECK(config->rules) << error;
+  std::unique_ptr<WindowManager> wm = WindowManager::Create(std::unique_ptr<DisplayBackend>(fake), config);
+  CHECK(wm->Init());
+  fake->ResetCounters();
+  const size_t idle_windows = fake->num_windows();
+
+  Totals totals;
+  // map phase only, MapRequest to mapped and decorated
+  Totals map_totals;
+  size_t mapped_windows = 0;
+  uint64_t map_requests = 0;
+  if (!recording.empty())
+  {
+    fake->set_create_unknown_windows(true);
+    Feed(wm.get(), fake, recording, options.batch, &totals);
+  }
+  else
+  {
+    SyntheticSession session(fake, options.clients);
+    std::vector<XEvent> events;
+    for (int round = 0; round < options.rounds; ++round)
+    {
+      events.clear();
+      session.MapAll(&events);
+      const uint64_t requests_before_map = fake->total_requests();
+      Feed(wm.get(), fake, events, options.batch, &map_totals);
+      map_requests += fake->total_requests() - requests_before_map;
+      mapped_windows = fake->num_windows() - idle_windows;
+
+      events.clear();
+      session.Interact(&events);
+      Feed(wm.get(), fake, events, options.batch, &totals);
+
+      events.clear();
+      session.UnmapAll(&events);
+      Feed(wm.get(), fake, events, options.batch, &totals);
+      session.DestroyClients();
+    }
+  }
+
+  totals.events += map_totals.events;
+  totals.allocations += map_totals.allocations;
+  totals.elapsed += map_totals.elapsed;
+
+  const double seconds = std::chrono::duration<double>(totals.elapsed).count();
+  const double events = static_cast<double>(std::max<uint64_t>(totals.events, 1));
+  const EventLoopStats& stats = wm->event_loop_stats();
+
+  std::printf("events:            %llu\n", static_cast<unsigned long long>(totals.events));
+  std::printf("events/sec:        %.0f\n", totals.events / seconds);
+  std::printf("ns/event:          %.1f\n", seconds * 1e9 / events);
+  std::printf("allocations/event: %.2f\n", totals.allocations / events);
+  std::printf("requests/event:    %.2f\n", fake->total_requests() / events);
+  std::printf("round trips/event: %.2f\n", fake->round_trips() / events);
+  std::printf("event loop:        %s\n", stats.ToString().c_str());
+  if (recording.empty())
+  {
+    const double maps = static_cast<double>(std::max(options.clients * options.rounds, 1));
+    const double map_seconds = std::chrono::duration<double>(map_totals.elapsed).count();
+    std::printf("mode:              %s\n", options.frameless ? "frameless" : "framed");
+    std::printf("windows/client:    %.2f\n", mapped_windows / static_cast<double>(std::max(options.clients, 1)));
+    std::printf("ns/map:            %.1f\n", map_seconds * 1e9 / maps);
+    std::printf("requests/map:      %.2f\n", map_requests / maps);
+  }
+  if (wm->rule_stats().evaluations > 0)
+  {
+    std::printf("rules:             %d, %s\n", options.rules, wm->rule_stats().ToString().c_str());
+  }
+  std::unique_ptr<StateReader> state_reader = StateReader::Open(fake->Name());
+  StateSnapshot snapshot;
+  if (state_reader && state_reader->Read(&snapshot))
+  {
+    std::printf("state export:      %llu updates, %zu clients left\n",
+                static_cast<unsigned long long>(snapshot.updates), snapshot.clients.size());
+  }
+  std::printf("BadWindow:         %llu\n", static_cast<unsigned long long>(fake->errors()));
+  for (int i = 0; i < FakeBackend::NUM_REQUESTS; ++i)
+  {
+    const FakeBackend::Request request = static_cast<FakeBackend::Request>(i);
+    if (fake->requests(request))
+    {
+      std::printf("  %-20s %llu\n",
+                  FakeBackend::RequestName(request),
+                  static_cast<unsigned long long>(fake->requests(request)));
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+// Checks EdgeStore against a brute-force search on random layouts and
+// measures what snapping costs per motion tick.  No X server involved.
+//
+//   snap_bench [--windows N] [--layouts N] [--queries N] [--distance N]
+//
+// Every layout is a screen with N random windows on it.  Each query drags a
+// random rect over it and compares the nearest vertical and horizontal edge
+// the store finds with a scan over every edge; ties may pick either side, so
+// the distance has to match and the delta has to lead onto an edge.  Then
+// times SnapMove() and SnapResize() on the last layout.  Exits non-zero on
+// any mismatch.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../snap.hpp"
+
+namespace
+{
+  struct Options
+  {
+    int windows = 1000;
+    int layouts = 200;
+    int queries = 1000;
+    int distance = 12;
+  };
+
+  bool ParseOptions(int argc, char** argv, Options* options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (i + 1 >= argc)
+      {
+        return false;
+      }
+      const int value = std::max(1, std::atoi(argv[++i]));
+      if (arg == "--windows")
+      {
+        options->windows = value;
+      }
+      else if (arg == "--layouts")
+      {
+        options->layouts = value;
+      }
+      else if (arg == "--queries")
+      {
+        options->queries = value;
+      }
+      else if (arg == "--distance")
+      {
+        options->distance = value;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const Rect<int> SCREEN(0, 0, 3840, 2160);
+
+  // keeps the timed results alive
+  volatile int sink;
+
+  // An edge at pos covering [begin, end) of the other axis
+  struct Edge
+  {
+    int pos;
+    int begin;
+    int end;
+  };
+
+  struct Layout
+  {
+    std::vector<Edge> vertical;
+    std::vector<Edge> horizontal;
+  };
+
+  Rect<int> RandomRect(std::mt19937* random)
+  {
+    std::uniform_int_distribution<int> x(-200, SCREEN.width);
+    std::uniform_int_distribution<int> y(-200, SCREEN.height);
+    std::uniform_int_distribution<int> size(1, 1200);
+    return Rect<int>(x(*random), y(*random), size(*random), size(*random));
+  }
+
+  // Fills edges the way WindowManager::OnButtonPress() does, and the same
+  // edges into layout for the brute force
+  void BuildLayout(int windows, std::mt19937* random, EdgeStore* edges, Layout* layout)
+  {
+    const int SPAN_MIN = std::numeric_limits<int>::min(), SPAN_MAX = std::numeric_limits<int>::max();
+    edges->Clear();
+    layout->vertical.clear();
+    layout->horizontal.clear();
+
+    edges->AddVerticalEdge(SCREEN.left());
+    edges->AddVerticalEdge(SCREEN.right());
+    edges->AddHorizontalEdge(SCREEN.top());
+    edges->AddHorizontalEdge(SCREEN.bottom());
+    layout->vertical.push_back(Edge{SCREEN.left(), SPAN_MIN, SPAN_MAX});
+    layout->vertical.push_back(Edge{SCREEN.right(), SPAN_MIN, SPAN_MAX});
+    layout->horizontal.push_back(Edge{SCREEN.top(), SPAN_MIN, SPAN_MAX});
+    layout->horizontal.push_back(Edge{SCREEN.bottom(), SPAN_MIN, SPAN_MAX});
+
+    for (int i = 0; i < windows; ++i)
+    {
+      const Rect<int> rect = RandomRect(random);
+      edges->AddRect(rect);
+      layout->vertical.push_back(Edge{rect.left(), rect.top(), rect.bottom()});
+      layout->vertical.push_back(Edge{rect.right(), rect.top(), rect.bottom()});
+      layout->horizontal.push_back(Edge{rect.top(), rect.left(), rect.right()});
+      layout->horizontal.push_back(Edge{rect.bottom(), rect.left(), rect.right()});
+    }
+    edges->Sort();
+  }
+
+  // Smallest distance from c0 or c1 to an edge overlapping [begin, end),
+  // max_distance + 1 if none is within max_distance
+  int BruteForce(const std::vector<Edge>& edges, int c0, int c1, int begin, int end, int max_distance)
+  {
+    int best = max_distance + 1;
+    for (const Edge& edge : edges)
+    {
+      if (edge.begin >= end || edge.end <= begin)
+      {
+        continue;
+      }
+      best = std::min(best, std::min(std::abs(edge.pos - c0), std::abs(edge.pos - c1)));
+    }
+    return best;
+  }
+
+  // Whether moving c0 or c1 by delta lands on an edge overlapping [begin, end)
+  bool LandsOnEdge(const std::vector<Edge>& edges, int c0, int c1, int begin, int end, int delta)
+  {
+    for (const Edge& edge : edges)
+    {
+      if (edge.begin < end && edge.end > begin && (edge.pos == c0 + delta || edge.pos == c1 + delta))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Returns whether the store and the brute force agree on one axis
+  bool Check(const EdgeStore& store, bool vertical, const std::vector<Edge>& edges,
+             int c0, int c1, int begin, int end, int max_distance)
+  {
+    int delta = 0;
+    const bool found = vertical
+        ? store.NearestVertical(c0, c1, begin, end, max_distance, &delta)
+        : store.NearestHorizontal(c0, c1, begin, end, max_distance, &delta);
+    const int expected = BruteForce(edges, c0, c1, begin, end, max_distance);
+    if (found != (expected <= max_distance))
+    {
+      return false;
+    }
+    return !found || (std::abs(delta) == expected && LandsOnEdge(edges, c0, c1, begin, end, delta));
+  }
+
+  double NanosPer(std::chrono::steady_clock::duration duration, long count)
+  {
+    return std::chrono::duration<double, std::nano>(duration).count() / count;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--windows N] [--layouts N] [--queries N] [--distance N]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 random(1);
+  Snapper snapper(options.distance);
+  Layout layout;
+  long checks = 0, mismatches = 0;
+  for (int l = 0; l < options.layouts; ++l)
+  {
+    BuildLayout(options.windows, &random, &snapper.edges(), &layout);
+    for (int q = 0; q < options.queries; ++q)
+    {
+      const Rect<int> r = RandomRect(&random);
+      // moves check both edges, resizes only the far one
+      const bool ok =
+          Check(snapper.edges(), true, layout.vertical, r.left(), r.right(), r.top(), r.bottom(), options.distance) &&
+          Check(snapper.edges(), false, layout.horizontal, r.top(), r.bottom(), r.left(), r.right(), options.distance) &&
+          Check(snapper.edges(), true, layout.vertical, r.right(), r.right(), r.top(), r.bottom(), options.distance) &&
+          Check(snapper.edges(), false, layout.horizontal, r.bottom(), r.bottom(), r.left(), r.right(), options.distance);
+      if (!ok && mismatches++ < 10)
+      {
+        std::fprintf(stderr, "mismatch: layout %d, rect %s\n", l, r.ToString().c_str());
+      }
+      ++checks;
+    }
+  }
+  std::printf("checked:     %ld drags on %d layouts of %d windows, %ld mismatches\n",
+              checks, options.layouts, options.windows, mismatches);
+
+  // a drag: the same layout, the rect moving a pixel at a time
+  const int TICKS = 1000000;
+  std::vector<Rect<int>> drag;
+  Rect<int> r = RandomRect(&random);
+  for (int i = 0; i < 4096; ++i)
+  {
+    r.x = (r.x + 1) % SCREEN.width;
+    r.y = (r.y + 1) % SCREEN.height;
+    drag.push_back(r);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < TICKS; ++i)
+  {
+    sink = snapper.SnapMove(drag[i & 4095]).x;
+  }
+  const double move_ns = NanosPer(std::chrono::steady_clock::now() - start, TICKS);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < TICKS; ++i)
+  {
+    sink = snapper.SnapResize(drag[i & 4095]).width;
+  }
+  const double resize_ns = NanosPer(std::chrono::steady_clock::now() - start, TICKS);
+  std::printf("SnapMove:    %.0f ns\n", move_ns);
+  std::printf("SnapResize:  %.0f ns\n", resize_ns);
+
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
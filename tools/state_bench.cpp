@@ -0,0 +1,192 @@
+// Measures what exporting state costs the window manager, and what readers
+// get out of it.  No X server involved, StateExport and StateReader talk
+// through a segment of their own.
+//
+//   state_bench [--clients N] [--updates N]
+//
+// Reports the cost of one drag step (a geometry change followed by
+// Publish()) with no reader, then again with a reader thread polling the
+// segment as fast as it can, and the reader's cost per snapshot.  The writer
+// moves every client to the same x per update, so the reader checks each
+// snapshot is consistent.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <glog/logging.h>
+#include "../state_export.hpp"
+#include "../state_reader.hpp"
+
+namespace
+{
+  struct Options
+  {
+    int clients = 200;
+    int updates = 200000;
+  };
+
+  bool ParseOptions(int argc, char** argv, Options* options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (i + 1 >= argc)
+      {
+        return false;
+      }
+      const int value = std::atoi(argv[++i]);
+      if (arg == "--clients")
+      {
+        options->clients = std::max(1, value);
+      }
+      else if (arg == "--updates")
+      {
+        options->updates = std::max(1, value);
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  double Seconds(std::chrono::steady_clock::duration duration)
+  {
+    return std::chrono::duration<double>(duration).count();
+  }
+
+  // frames are client + 1
+  Window Frame(int client)
+  {
+    return 0x200000 + 2 * client + 1;
+  }
+
+  // ns per drag step, one client moved per update
+  double DragSteps(StateExport* state_export, const Options& options)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (int update = 0; update < options.updates; ++update)
+    {
+      state_export->SetGeometry(Frame(update % options.clients), Rect<int>(update, 0, 320, 240));
+      state_export->Publish();
+    }
+    return Seconds(std::chrono::steady_clock::now() - start) * 1e9 / options.updates;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--clients N] [--updates N]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::string display = "state_bench_" + std::to_string(getpid());
+  std::unique_ptr<StateExport> state_export = StateExport::Create(SharedStateName(display));
+  if (!state_export)
+  {
+    return EXIT_FAILURE;
+  }
+  for (int client = 0; client < options.clients; ++client)
+  {
+    state_export->AddClient(Frame(client) - 1, Frame(client), Rect<int>(0, 0, 320, 240), -1);
+  }
+  state_export->Publish();
+
+  std::printf("clients: %d, segment: %zu bytes\n", options.clients, sizeof(SharedState));
+  std::printf("drag step, no reader: %.0f ns\n", DragSteps(state_export.get(), options));
+
+  std::unique_ptr<StateReader> reader = StateReader::Open(display);
+  if (!reader)
+  {
+    std::fprintf(stderr, "Failed to open %s\n", SharedStateName(display).c_str());
+    return EXIT_FAILURE;
+  }
+
+  // polls until done, checking snapshots if check is set
+  struct ReaderStats
+  {
+    uint64_t reads = 0;
+    uint64_t failed = 0;
+    uint64_t inconsistent = 0;
+    double seconds = 0;
+  };
+  std::atomic<bool> done(false);
+  const auto poll = [&reader, &done] (bool check, ReaderStats* stats)
+  {
+    StateSnapshot snapshot;
+    const auto start = std::chrono::steady_clock::now();
+    while (!done.load(std::memory_order_relaxed))
+    {
+      if (!reader->Read(&snapshot))
+      {
+        ++stats->failed;
+        continue;
+      }
+      ++stats->reads;
+      for (const SharedClient& client : snapshot.clients)
+      {
+        if (check && client.x != snapshot.clients[0].x)
+        {
+          ++stats->inconsistent;
+          break;
+        }
+      }
+    }
+    stats->seconds = Seconds(std::chrono::steady_clock::now() - start);
+  };
+
+  // every client at the same x in every published state
+  const auto move_all = [&state_export, &options] (int x)
+  {
+    for (int client = 0; client < options.clients; ++client)
+    {
+      state_export->SetGeometry(Frame(client), Rect<int>(x, 0, 320, 240));
+    }
+    state_export->Publish();
+  };
+  move_all(-1);
+
+  ReaderStats checked;
+  std::thread checking_reader(poll, true, &checked);
+  const auto start = std::chrono::steady_clock::now();
+  for (int update = 0; update < options.updates; ++update)
+  {
+    move_all(update);
+  }
+  const double all_moved = Seconds(std::chrono::steady_clock::now() - start) * 1e9 / options.updates;
+  done = true;
+  checking_reader.join();
+
+  done = false;
+  ReaderStats polling;
+  std::thread polling_reader(poll, false, &polling);
+  const double contended = DragSteps(state_export.get(), options);
+  done = true;
+  polling_reader.join();
+
+  std::printf("drag step, polling reader: %.0f ns\n", contended);
+  std::printf("all clients moved, polling reader: %.0f ns\n", all_moved);
+  for (const ReaderStats* stats : {&checked, &polling})
+  {
+    std::printf("reader: %.0f ns per snapshot, %llu snapshots, %llu retried out",
+                stats->reads ? stats->seconds * 1e9 / stats->reads : 0.0,
+                static_cast<unsigned long long>(stats->reads),
+                static_cast<unsigned long long>(stats->failed));
+    if (stats == &checked)
+    {
+      std::printf(", %llu inconsistent", static_cast<unsigned long long>(stats->inconsistent));
+    }
+    std::printf("\n");
+  }
+  return checked.inconsistent == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+// Checks that timers scheduled from the event loop don't fire early.  No X
+// server involved, runs the window manager on the fake backend.
+//
+//   timer_check
+//
+// The wheel's time only moves after each batch, so a handler running right
+// after the loop blocked for a while sees a stale wheel.  Each case blocks,
+// schedules, then steps the clock and checks the callback runs exactly at its
+// deadline.  The ping case closes a client after a long idle period and
+// checks it is only killed once a ping really went unanswered.  Exits
+// non-zero if any check failed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+extern "C"
+{
+#include <X11/keysym.h>
+}
+
+#include <glog/logging.h>
+#include "../config.hpp"
+#include "../fake_backend.hpp"
+#include "../timer_wheel.hpp"
+#include "../window_manager.hpp"
+
+namespace
+{
+  int failures = 0;
+
+  void Expect(bool condition, const char* what)
+  {
+    std::printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+    if (!condition)
+    {
+      ++failures;
+    }
+  }
+
+  XEvent MakeEvent(int type)
+  {
+    XEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    return e;
+  }
+
+  // The wheel on its own, with a lagging now
+  void CheckWheel()
+  {
+    TimerWheel wheel(1);
+    bool relative = false, absolute = false;
+    wheel.Schedule(100, [&relative] () { relative = true; });
+    wheel.ScheduleAt(5100, [&absolute] () { absolute = true; });
+
+    wheel.Advance(5000);
+    Expect(relative, "Schedule() is relative to the last Advance()");
+    Expect(!absolute, "ScheduleAt() doesn't run before its expiry");
+    wheel.Advance(5099);
+    Expect(!absolute, "ScheduleAt() doesn't run 1 ms before its expiry");
+    wheel.Advance(5100);
+    Expect(absolute, "ScheduleAt() runs at its expiry");
+  }
+
+  // WindowManager::Schedule() from a handler running after a long block
+  void CheckEventLoop()
+  {
+    FakeBackend* fake = new FakeBackend();
+    std::unique_ptr<WindowManager> wm = WindowManager::Create(std::unique_ptr<DisplayBackend>(fake), DefaultConfig());
+    CHECK(wm->Init());
+    // let the timers Init() scheduled settle
+    wm->ProcessBatch();
+
+    // the loop sat in WaitForEvents() for 5 s, then a handler schedules
+    // before the wheel caught up
+    const uint64_t DELAY = 100;
+    bool fired = false;
+    fake->AdvanceClock(5000);
+    const uint64_t scheduled_at = fake->Now();
+    wm->Schedule(DELAY, [&fired] () { fired = true; });
+    wm->ProcessBatch();
+    Expect(!fired, "timer scheduled after a block doesn't run in the same iteration");
+    Expect(fake->timer_deadline() != 0 && fake->timer_deadline() <= scheduled_at + DELAY,
+           "timer is armed no later than now + delay");
+
+    fake->AdvanceClock(DELAY - 1);
+    wm->ProcessBatch();
+    Expect(!fired, "timer doesn't run 1 ms early");
+
+    fake->AdvanceClock(1);
+    wm->ProcessBatch();
+    Expect(fired, "timer runs at now + delay");
+  }
+
+  // Alt+F4 on a _NET_WM_PING client after the loop idled for longer than
+  // ping_timeout
+  void CheckPing()
+  {
+    FakeBackend* fake = new FakeBackend();
+    std::shared_ptr<const Config> config = DefaultConfig();
+    std::unique_ptr<WindowManager> wm = WindowManager::Create(std::unique_ptr<DisplayBackend>(fake), config);
+    CHECK(wm->Init());
+
+    const Window win = fake->CreateClient(100, 100, 400, 300);
+    const Atom ping_atom = fake->InternAtom("_NET_WM_PING", false);
+    fake->SetClientProtocols(win, {fake->InternAtom("WM_DELETE_WINDOW", false), ping_atom});
+    XEvent e = MakeEvent(MapRequest);
+    e.xmaprequest.parent = fake->Root();
+    e.xmaprequest.window = win;
+    fake->PushEvent(e);
+    wm->ProcessBatch();
+    const Window frame = fake->window(win)->parent;
+
+    XEvent close = MakeEvent(KeyPress);
+    close.xkey.window = win;
+    close.xkey.root = fake->Root();
+    close.xkey.state = Mod1Mask;
+    close.xkey.keycode = fake->KeysymToKeycode(XK_F4);
+
+    fake->AdvanceClock(10 * config->ping_timeout);
+    const Time timestamp = static_cast<uint32_t>(fake->Now());
+    fake->PushEvent(close);
+    wm->ProcessBatch();
+    Expect(fake->window(frame)->border != config->unresponsive_border_color,
+           "a close after a long idle doesn't mark the client unresponsive right away");
+
+    // the client answers the ping but keeps its window, e.g. to ask about
+    // unsaved changes
+    fake->AdvanceClock(10);
+    XEvent pong = MakeEvent(ClientMessage);
+    pong.xclient.window = fake->Root();
+    pong.xclient.message_type = fake->InternAtom("WM_PROTOCOLS", false);
+    pong.xclient.format = 32;
+    pong.xclient.data.l[0] = ping_atom;
+    pong.xclient.data.l[1] = timestamp;
+    pong.xclient.data.l[2] = win;
+    fake->PushEvent(pong);
+    wm->ProcessBatch();
+    fake->AdvanceClock(config->ping_timeout);
+    fake->PushEvent(close);
+    wm->ProcessBatch();
+    Expect(fake->requests(FakeBackend::REQ_KILL_CLIENT) == 0, "a second close of a client that answered doesn't kill");
+
+    // that close pinged again, this time nobody answers
+    fake->AdvanceClock(config->ping_timeout - 1);
+    wm->ProcessBatch();
+    Expect(fake->window(frame)->border != config->unresponsive_border_color, "not unresponsive 1 ms before the timeout");
+    fake->AdvanceClock(1);
+    wm->ProcessBatch();
+    Expect(fake->window(frame)->border == config->unresponsive_border_color, "unresponsive once the ping timed out");
+    fake->PushEvent(close);
+    wm->ProcessBatch();
+    Expect(fake->requests(FakeBackend::REQ_KILL_CLIENT) == 1, "a close after an unanswered ping kills");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  CheckWheel();
+  CheckEventLoop();
+  CheckPing();
+
+  std::printf("%d failures\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
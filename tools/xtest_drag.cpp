@@ -0,0 +1,159 @@
+// Plays a user against the window manager running on $DISPLAY through XTest:
+// opens a few client windows, alt-drags each of them around and alt-tabs
+// through them.  Meant for an Xvfb with the window manager tracing latency,
+// see tools/latency.sh.
+//
+//   xtest_drag [--windows N] [--drags N] [--steps N] [--interval-ms N]
+//
+// Motion is injected every --interval-ms (8, about a 120Hz mouse), so the
+// window manager sees input at the pace of a real drag.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C"
+{
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+}
+
+namespace
+{
+  struct Options
+  {
+    int windows = 4;
+    int drags = 50;
+    int steps = 30;
+    int interval_ms = 8;
+  };
+
+  bool ParseOptions(int argc, char** argv, Options* options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (i + 1 >= argc)
+      {
+        return false;
+      }
+      const int value = std::atoi(argv[++i]);
+      if (arg == "--windows")
+      {
+        options->windows = std::max(1, value);
+      }
+      else if (arg == "--drags")
+      {
+        options->drags = value;
+      }
+      else if (arg == "--steps")
+      {
+        options->steps = std::max(1, value);
+      }
+      else if (arg == "--interval-ms")
+      {
+        options->interval_ms = value;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Creates and maps a top level window, returns once it's mapped (i.e. the
+  // window manager framed it)
+  Window OpenWindow(Display* display, int x, int y)
+  {
+    const Window win = XCreateSimpleWindow(
+        display, DefaultRootWindow(display), x, y, 320, 240, 0, 0, 0xffffff);
+    XSelectInput(display, win, StructureNotifyMask);
+    XMapWindow(display, win);
+    XEvent e;
+    do
+    {
+      XNextEvent(display, &e);
+    } while (e.type != MapNotify || e.xmap.window != win);
+    return win;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!ParseOptions(argc, argv, &options))
+  {
+    std::fprintf(stderr, "usage: %s [--windows N] [--drags N] [--steps N] [--interval-ms N]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Display* display = XOpenDisplay(nullptr);
+  if (display == nullptr)
+  {
+    std::fprintf(stderr, "Failed to open X display %s\n", XDisplayName(nullptr));
+    return EXIT_FAILURE;
+  }
+  int event_base, error_base, major, minor;
+  if (!XTestQueryExtension(display, &event_base, &error_base, &major, &minor))
+  {
+    std::fprintf(stderr, "XTest extension missing\n");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Window> windows;
+  for (int i = 0; i < options.windows; ++i)
+  {
+    windows.push_back(OpenWindow(display, 100 + i * 200, 100 + i * 100));
+  }
+
+  const KeyCode alt = XKeysymToKeycode(display, XK_Alt_L);
+  const KeyCode tab = XKeysymToKeycode(display, XK_Tab);
+  const useconds_t interval = options.interval_ms * 1000;
+
+  for (int drag = 0; drag < options.drags; ++drag)
+  {
+    // grab the window by its middle, wherever the last drag left it
+    const Window win = windows[drag % windows.size()];
+    Window child;
+    int x, y;
+    XWindowAttributes attrs;
+    XGetWindowAttributes(display, win, &attrs);
+    XTranslateCoordinates(display, win, DefaultRootWindow(display), 0, 0, &x, &y, &child);
+    XTestFakeMotionEvent(display, -1, x + attrs.width / 2, y + attrs.height / 2, CurrentTime);
+
+    XTestFakeKeyEvent(display, alt, True, CurrentTime);
+    XTestFakeButtonEvent(display, Button1, True, CurrentTime);
+    XSync(display, False);
+
+    // out and back, so windows stay on screen
+    const int direction = drag % 2 ? -1 : 1;
+    for (int step = 0; step < options.steps; ++step)
+    {
+      const int dx = step < options.steps / 2 ? 4 : -4;
+      XTestFakeRelativeMotionEvent(display, direction * dx, dx / 2, CurrentTime);
+      XFlush(display);
+      usleep(interval);
+    }
+
+    XTestFakeButtonEvent(display, Button1, False, CurrentTime);
+
+    // and on to the next window
+    XTestFakeKeyEvent(display, tab, True, CurrentTime);
+    XTestFakeKeyEvent(display, tab, False, CurrentTime);
+    XTestFakeKeyEvent(display, alt, False, CurrentTime);
+    XSync(display, False);
+    usleep(interval);
+  }
+
+  for (const Window win : windows)
+  {
+    XDestroyWindow(display, win);
+  }
+  XCloseDisplay(display);
+  return EXIT_SUCCESS;
+}
@@ -1,126 +1,426 @@
 #include "util.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
 #include <algorithm>
 #include <vector>
 
-std::string ToString(const XEvent& xev)
+namespace
 {
-  static const char*  const X_EVENT_TYPE_NAMES[] = 
-  {
-    "",
-    "",
-    "KeyPress",
-    "KeyRelease",
-    "ButtonPress",
-    "ButtonRelease",
-    "MotionNotify",
-    "EnterNotify",
-    "LeaveNotify",
-    "FocusIn",
-    "FocusOut",
-    "KeymapNotify",
-    "Expose",
-    "GraphicsExpose",
-    "NoExpose",
-    "VisibilityNotify",
-    "CreateNotify",
-    "DestroyNotify",
-    "UnmapNotify",
-    "MapNotify",
-    "MapRequest",
-    "ReparentNotify",
-    "ConfigureNotify",
-    "ConfigureRequest",
-    "GravityNotify",
-    "ResizeRequest",
-    "CirculateNotify",
-    "CirculateRequest",
-    "PropertyNotify",
-    "SelectionClear",
-    "SelectionRequest",
-    "SelectionNotify",
-    "ColormapNotify",
-    "ClientMessage",
-    "MappingNotify",
+  // How a field is printed
+  enum FieldKind
+  {
+    // XID in hex, like xwininfo
+    FIELD_WINDOW,
+    FIELD_ATOM,
+    FIELD_INT,
+    FIELD_UINT,
+    FIELD_BOOL,
+    FIELD_TIME,
+    // XConfigureRequestEvent::value_mask as X|Y|Width...
+    FIELD_VALUE_MASK,
+    // two ints, offset and second
+    FIELD_SIZE,
+    FIELD_POSITION,
+  };
+
+  struct EventField
+  {
+    const char* name;
+    FieldKind kind;
+    // into XEvent, every member of the union starts at 0
+    uint16_t offset;
+    uint16_t second;
   };
 
-  std::vector<std::pair<std::string, std::string>> properties;
-  switch (xev.type)
-  {
-    case CreateNotify:
-      properties.emplace_back("window", ToString(xev.xcreatewindow.window));
-      properties.emplace_back("parent", ToString(xev.xcreatewindow.parent));
-      properties.emplace_back("size", Size<int>(xev.xcreatewindow.width, xev.xcreatewindow.height).ToString());
-      properties.emplace_back("position", Position<int>(xev.xcreatewindow.x, xev.xcreatewindow.y).ToString());
-      properties.emplace_back("border_width", ToString(xev.xcreatewindow.border_width));
-      break;
-    case DestroyNotify:
-      properties.emplace_back("window", ToString(xev.xdestroywindow.window));
-      break;
-    case MapNotify:
-      properties.emplace_back("window", ToString(xev.xmap.window));
-      properties.emplace_back("event", ToString(xev.xmap.event));
-      properties.emplace_back("override_redirect", ToString(static_cast<bool>(xev.xmap.override_redirect)));
-      break;
-    case UnmapNotify:
-      properties.emplace_back("window", ToString(xev.xunmap.window));
-      properties.emplace_back("event", ToString(xev.xunmap.event));
-      properties.emplace_back("from_configure", ToString(static_cast<bool>(xev.xunmap.from_configure)));
-      break;
-    case ConfigureNotify:
-      properties.emplace_back("window", ToString(xev.xconfigure.window));
-      properties.emplace_back("size", Size<int>(xev.xconfigure.width, xev.xconfigure.height).ToString());
-      properties.emplace_back("position", Position<int>(xev.xconfigure.x, xev.xconfigure.y).ToString());
-      properties.emplace_back("border_width", ToString(xev.xconfigure.border_width));
-      properties.emplace_back("override_redirect", ToString(static_cast<bool>(xev.xconfigure.override_redirect)));
-      break;
-    case ReparentNotify:
-      properties.emplace_back("window", ToString(xev.xreparent.window));
-      properties.emplace_back("parent", ToString(xev.xreparent.parent));
-      properties.emplace_back("position", Position<int>(xev.xreparent.x, xev.xreparent.y).ToString());
-      properties.emplace_back("override_redirect", ToString(static_cast<bool>(xev.xreparent.override_redirect)));
-      break;
-    case MapRequest:
-      properties.emplace_back("window", ToString(xev.xmaprequest.window));
-      break;
-    case ConfigureRequest:
-      properties.emplace_back("window", ToString(xev.xconfigurerequest.window));
-      properties.emplace_back("parent", ToString(xev.xconfigurerequest.parent));
-      properties.emplace_back("position", Position<int>(xev.xconfigurerequest.x, xev.xconfigurerequest.y).ToString());
-      properties.emplace_back("size", Size<int>(xev.xconfigurerequest.width, xev.xconfigurerequest.height).ToString());
-      properties.emplace_back("border_width", ToString(xev.xconfigurerequest.border_width));
-      break;
-    case ButtonPress:
-    case ButtonRelease:
-      properties.emplace_back("window", ToString(xev.xbutton.window));
-      properties.emplace_back("button", ToString(xev.xbutton.button));
-      properties.emplace_back("position_root", Position<int>(xev.xbutton.x_root, xev.xbutton.y_root).ToString());
-      break;
-    case MotionNotify:
-      properties.emplace_back("window", ToString(xev.xmotion.window));
-      properties.emplace_back("position_root", Position<int>(xev.xmotion.x_root, xev.xmotion.y_root).ToString());
-      properties.emplace_back("state", ToString(xev.xmotion.state));
-      properties.emplace_back("time", ToString(xev.xmotion.time));
-      break;
-    case KeyPress:
-    case KeyRelease:
-      properties.emplace_back("window", ToString(xev.xkey.window));
-      properties.emplace_back("state", ToString(xev.xkey.state));
-      properties.emplace_back("keycode", ToString(xev.xkey.keycode));
-      break;
-    default:
-      break;
+  // Offset of a member that has to be of type M, so a field can't be read
+  // as the wrong type
+  template <typename T, typename M>
+  constexpr uint16_t FieldOffset(M T::*, size_t offset)
+  {
+    return offset;
   }
 
-  // Build final string
-  const std::string properties_string = Join(properties, ", ",
-                                         [] (const std::pair<std::string, std::string> &pair)
-                                         {
-                                           return pair.first + ": " + pair.second;
-                                         });
-  std::ostringstream out;
-  out << X_EVENT_TYPE_NAMES[xev.type] << " { " << properties_string << " }";
-  return out.str();
+#define EVENT_FIELD(kind, type, event, member) \
+  EventField{#member, kind, FieldOffset<event, type>(&event::member, offsetof(event, member)), 0}
+#define EVENT_PAIR(kind, name, event, first, second) \
+  EventField{name, kind, FieldOffset<event, int>(&event::first, offsetof(event, first)), \
+             FieldOffset<event, int>(&event::second, offsetof(event, second))}
+
+  constexpr EventField KEY_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XKeyEvent, window),
+    EVENT_FIELD(FIELD_UINT, unsigned int, XKeyEvent, state),
+    EVENT_FIELD(FIELD_UINT, unsigned int, XKeyEvent, keycode),
+    EVENT_FIELD(FIELD_TIME, Time, XKeyEvent, time),
+  };
+
+  constexpr EventField BUTTON_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XButtonEvent, window),
+    EVENT_FIELD(FIELD_UINT, unsigned int, XButtonEvent, button),
+    EVENT_PAIR(FIELD_POSITION, "position_root", XButtonEvent, x_root, y_root),
+    EVENT_FIELD(FIELD_UINT, unsigned int, XButtonEvent, state),
+    EVENT_FIELD(FIELD_TIME, Time, XButtonEvent, time),
+  };
+
+  constexpr EventField MOTION_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XMotionEvent, window),
+    EVENT_PAIR(FIELD_POSITION, "position_root", XMotionEvent, x_root, y_root),
+    EVENT_FIELD(FIELD_UINT, unsigned int, XMotionEvent, state),
+    EVENT_FIELD(FIELD_TIME, Time, XMotionEvent, time),
+  };
+
+  constexpr EventField CROSSING_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XCrossingEvent, window),
+    EVENT_PAIR(FIELD_POSITION, "position_root", XCrossingEvent, x_root, y_root),
+    EVENT_FIELD(FIELD_INT, int, XCrossingEvent, mode),
+    EVENT_FIELD(FIELD_INT, int, XCrossingEvent, detail),
+  };
+
+  constexpr EventField FOCUS_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XFocusChangeEvent, window),
+    EVENT_FIELD(FIELD_INT, int, XFocusChangeEvent, mode),
+    EVENT_FIELD(FIELD_INT, int, XFocusChangeEvent, detail),
+  };
+
+  constexpr EventField EXPOSE_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XExposeEvent, window),
+    EVENT_PAIR(FIELD_SIZE, "size", XExposeEvent, width, height),
+    EVENT_PAIR(FIELD_POSITION, "position", XExposeEvent, x, y),
+    EVENT_FIELD(FIELD_INT, int, XExposeEvent, count),
+  };
+
+  constexpr EventField CREATE_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XCreateWindowEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XCreateWindowEvent, parent),
+    EVENT_PAIR(FIELD_SIZE, "size", XCreateWindowEvent, width, height),
+    EVENT_PAIR(FIELD_POSITION, "position", XCreateWindowEvent, x, y),
+    EVENT_FIELD(FIELD_INT, int, XCreateWindowEvent, border_width),
+    EVENT_FIELD(FIELD_BOOL, Bool, XCreateWindowEvent, override_redirect),
+  };
+
+  constexpr EventField DESTROY_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XDestroyWindowEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XDestroyWindowEvent, event),
+  };
+
+  constexpr EventField UNMAP_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XUnmapEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XUnmapEvent, event),
+    EVENT_FIELD(FIELD_BOOL, Bool, XUnmapEvent, from_configure),
+  };
+
+  constexpr EventField MAP_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XMapEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XMapEvent, event),
+    EVENT_FIELD(FIELD_BOOL, Bool, XMapEvent, override_redirect),
+  };
+
+  constexpr EventField MAP_REQUEST_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XMapRequestEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XMapRequestEvent, parent),
+  };
+
+  constexpr EventField REPARENT_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XReparentEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XReparentEvent, parent),
+    EVENT_PAIR(FIELD_POSITION, "position", XReparentEvent, x, y),
+    EVENT_FIELD(FIELD_BOOL, Bool, XReparentEvent, override_redirect),
+  };
+
+  constexpr EventField CONFIGURE_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XConfigureEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XConfigureEvent, event),
+    EVENT_PAIR(FIELD_SIZE, "size", XConfigureEvent, width, height),
+    EVENT_PAIR(FIELD_POSITION, "position", XConfigureEvent, x, y),
+    EVENT_FIELD(FIELD_INT, int, XConfigureEvent, border_width),
+    EVENT_FIELD(FIELD_BOOL, Bool, XConfigureEvent, override_redirect),
+  };
+
+  constexpr EventField CONFIGURE_REQUEST_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XConfigureRequestEvent, window),
+    EVENT_FIELD(FIELD_WINDOW, Window, XConfigureRequestEvent, parent),
+    EVENT_PAIR(FIELD_POSITION, "position", XConfigureRequestEvent, x, y),
+    EVENT_PAIR(FIELD_SIZE, "size", XConfigureRequestEvent, width, height),
+    EVENT_FIELD(FIELD_INT, int, XConfigureRequestEvent, border_width),
+    EVENT_FIELD(FIELD_VALUE_MASK, unsigned long, XConfigureRequestEvent, value_mask),
+  };
+
+  constexpr EventField PROPERTY_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XPropertyEvent, window),
+    EVENT_FIELD(FIELD_ATOM, Atom, XPropertyEvent, atom),
+    EVENT_FIELD(FIELD_INT, int, XPropertyEvent, state),
+    EVENT_FIELD(FIELD_TIME, Time, XPropertyEvent, time),
+  };
+
+  constexpr EventField CLIENT_MESSAGE_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_WINDOW, Window, XClientMessageEvent, window),
+    EVENT_FIELD(FIELD_ATOM, Atom, XClientMessageEvent, message_type),
+    EVENT_FIELD(FIELD_INT, int, XClientMessageEvent, format),
+  };
+
+  constexpr EventField MAPPING_FIELDS[] =
+  {
+    EVENT_FIELD(FIELD_INT, int, XMappingEvent, request),
+    EVENT_FIELD(FIELD_INT, int, XMappingEvent, first_keycode),
+    EVENT_FIELD(FIELD_INT, int, XMappingEvent, count),
+  };
+
+#undef EVENT_FIELD
+#undef EVENT_PAIR
+
+  struct EventType
+  {
+    const char* name;
+    const EventField* fields;
+    size_t num_fields;
+  };
+
+  template <size_t N>
+  constexpr EventType Type(const char* name, const EventField (&fields)[N])
+  {
+    return EventType{name, fields, N};
+  }
+
+  constexpr EventType Type(const char* name)
+  {
+    return EventType{name, nullptr, 0};
+  }
+
+  // By event type, up to and including GenericEvent
+  constexpr EventType EVENT_TYPES[] =
+  {
+    Type(""),
+    Type(""),
+    Type("KeyPress", KEY_FIELDS),
+    Type("KeyRelease", KEY_FIELDS),
+    Type("ButtonPress", BUTTON_FIELDS),
+    Type("ButtonRelease", BUTTON_FIELDS),
+    Type("MotionNotify", MOTION_FIELDS),
+    Type("EnterNotify", CROSSING_FIELDS),
+    Type("LeaveNotify", CROSSING_FIELDS),
+    Type("FocusIn", FOCUS_FIELDS),
+    Type("FocusOut", FOCUS_FIELDS),
+    Type("KeymapNotify"),
+    Type("Expose", EXPOSE_FIELDS),
+    Type("GraphicsExpose"),
+    Type("NoExpose"),
+    Type("VisibilityNotify"),
+    Type("CreateNotify", CREATE_FIELDS),
+    Type("DestroyNotify", DESTROY_FIELDS),
+    Type("UnmapNotify", UNMAP_FIELDS),
+    Type("MapNotify", MAP_FIELDS),
+    Type("MapRequest", MAP_REQUEST_FIELDS),
+    Type("ReparentNotify", REPARENT_FIELDS),
+    Type("ConfigureNotify", CONFIGURE_FIELDS),
+    Type("ConfigureRequest", CONFIGURE_REQUEST_FIELDS),
+    Type("GravityNotify"),
+    Type("ResizeRequest"),
+    Type("CirculateNotify"),
+    Type("CirculateRequest"),
+    Type("PropertyNotify", PROPERTY_FIELDS),
+    Type("SelectionClear"),
+    Type("SelectionRequest"),
+    Type("SelectionNotify"),
+    Type("ColormapNotify"),
+    Type("ClientMessage", CLIENT_MESSAGE_FIELDS),
+    Type("MappingNotify", MAPPING_FIELDS),
+    Type("GenericEvent"),
+  };
+  static_assert(sizeof(EVENT_TYPES) / sizeof(EVENT_TYPES[0]) == LASTEvent,
+                "EVENT_TYPES out of sync with X.h");
+
+  // Appends to a fixed buffer, dropping whatever doesn't fit.  end_ is kept
+  // free for the terminating NUL.
+  class BufferWriter
+  {
+    public:
+      BufferWriter(char* buffer, size_t size)
+          : begin_(buffer),
+            p_(buffer),
+            end_(buffer + size - 1)
+      {
+      }
+
+      void Append(const char* s)
+      {
+        while (*s && p_ < end_)
+        {
+          *p_++ = *s++;
+        }
+      }
+
+      void Append(char c)
+      {
+        if (p_ < end_)
+        {
+          *p_++ = c;
+        }
+      }
+
+      void AppendUnsigned(unsigned long value, unsigned int base = 10)
+      {
+        // backwards into a scratch buffer, 64 bits fit in 20 digits
+        char digits[24];
+        char* d = digits + sizeof(digits);
+        *--d = '\0';
+        do
+        {
+          *--d = "0123456789abcdef"[value % base];
+          value /= base;
+        } while (value);
+        Append(d);
+      }
+
+      void AppendSigned(long value)
+      {
+        if (value < 0)
+        {
+          Append('-');
+          // well defined for LONG_MIN too
+          AppendUnsigned(0ul - static_cast<unsigned long>(value));
+        }
+        else
+        {
+          AppendUnsigned(value);
+        }
+      }
+
+      // NUL terminates, returns the length
+      size_t Finish()
+      {
+        *p_ = '\0';
+        return p_ - begin_;
+      }
+
+    private:
+      char* const begin_;
+      char* p_;
+      char* const end_;
+  };
+
+  template <typename T>
+  T Read(const XEvent& xev, uint16_t offset)
+  {
+    T value;
+    std::memcpy(&value, reinterpret_cast<const char*>(&xev) + offset, sizeof(value));
+    return value;
+  }
+
+  void AppendField(const XEvent& xev, const EventField& field, BufferWriter* out)
+  {
+    switch (field.kind)
+    {
+      case FIELD_WINDOW:
+      case FIELD_ATOM:
+        out->Append("0x");
+        out->AppendUnsigned(Read<unsigned long>(xev, field.offset), 16);
+        break;
+      case FIELD_INT:
+        out->AppendSigned(Read<int>(xev, field.offset));
+        break;
+      case FIELD_UINT:
+        out->AppendUnsigned(Read<unsigned int>(xev, field.offset));
+        break;
+      case FIELD_BOOL:
+        out->Append(Read<Bool>(xev, field.offset) ? "true" : "false");
+        break;
+      case FIELD_TIME:
+        out->AppendUnsigned(Read<Time>(xev, field.offset));
+        break;
+      case FIELD_VALUE_MASK:
+      {
+        static const char* const CW_NAMES[] = {"X", "Y", "Width", "Height", "BorderWidth", "Sibling", "StackMode"};
+        const unsigned long mask = Read<unsigned long>(xev, field.offset);
+        bool first = true;
+        for (size_t bit = 0; bit < sizeof(CW_NAMES) / sizeof(CW_NAMES[0]); ++bit)
+        {
+          if (mask & (1ul << bit))
+          {
+            if (!first)
+            {
+              out->Append('|');
+            }
+            out->Append(CW_NAMES[bit]);
+            first = false;
+          }
+        }
+        break;
+      }
+      case FIELD_SIZE:
+        out->AppendSigned(Read<int>(xev, field.offset));
+        out->Append('x');
+        out->AppendSigned(Read<int>(xev, field.second));
+        break;
+      case FIELD_POSITION:
+        out->Append('(');
+        out->AppendSigned(Read<int>(xev, field.offset));
+        out->Append(", ");
+        out->AppendSigned(Read<int>(xev, field.second));
+        out->Append(')');
+        break;
+    }
+  }
+}
+
+const char* XEventTypeName(int type)
+{
+  if (type < 0 || type >= LASTEvent)
+  {
+    // extension events
+    return "";
+  }
+  return EVENT_TYPES[type].name;
+}
+
+size_t FormatEvent(const XEvent& xev, char* buffer, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+  BufferWriter out(buffer, size);
+  const char* name = XEventTypeName(xev.type);
+  if (*name)
+  {
+    out.Append(name);
+  }
+  else
+  {
+    out.Append("Event ");
+    out.AppendSigned(xev.type);
+  }
+
+  out.Append(" {");
+  if (xev.type >= 0 && xev.type < LASTEvent)
+  {
+    const EventType& type = EVENT_TYPES[xev.type];
+    for (size_t i = 0; i < type.num_fields; ++i)
+    {
+      out.Append(i ? ", " : " ");
+      out.Append(type.fields[i].name);
+      out.Append(": ");
+      AppendField(xev, type.fields[i], &out);
+    }
+  }
+  out.Append(" }");
+  return out.Finish();
 }
 
 std::string XConfigureWindowValueMaskToString(unsigned long value_mask)
@@ -284,5 +584,10 @@ std::string XRequestCodeToString(unsigned char request_code)
       "NoOperation",
   };
 
+  // extension requests aren't named
+  if (request_code >= sizeof(X_REQUEST_CODE_NAMES) / sizeof(X_REQUEST_CODE_NAMES[0]))
+  {
+    return "";
+  }
   return X_REQUEST_CODE_NAMES[request_code];
 }
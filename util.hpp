@@ -73,6 +73,44 @@ std::string Vector2D<T>::ToString() const
   return out.str();
 }
 
+template <typename T>
+struct Rect
+{
+  T x;
+  T y;
+  T width;
+  T height;
+
+  Rect() = default;
+  Rect(T _x, T _y, T w, T h) : x(_x), y(_y), width(w), height(h) { }
+  Rect(const Position<T>& pos, const Size<T>& size)
+      : x(pos.x), y(pos.y), width(size.width), height(size.height) { }
+
+  T left() const { return x; }
+  T right() const { return x + width; }
+  T top() const { return y; }
+  T bottom() const { return y + height; }
+
+  Position<T> position() const { return Position<T>(x, y); }
+  Size<T> size() const { return Size<T>(width, height); }
+
+  std::string ToString() const;
+};
+
+template <typename T>
+std::string Rect<T>::ToString() const
+{
+  std::ostringstream out;
+  out << width << 'x' << height << '+' << x << '+' << y;
+  return out.str();
+}
+
+template<typename T>
+std::ostream& operator<< (std::ostream& out, const Rect<T>& rect)
+{
+  return out << rect.ToString();
+}
+
 template<typename T>
 std::ostream& operator<< (std::ostream& out, Vector2D<T>& vec)
 {
@@ -139,7 +177,17 @@ Size<T> operator- (const Size<T>& lhs, const Vector2D<T>& rhs)
   return Size<T>(lhs.width - rhs.x, lhs.height - rhs.y);
 }
 
-extern std::string ToString(const XEvent* xev);
+// Name of an event type, "" for extension events
+extern const char* XEventTypeName(int type);
+
+// Buffer size that fits the description of any core event
+const size_t EVENT_DESCRIPTION_SIZE = 256;
+
+// Writes a one line description of xev into buffer, e.g.
+// "MapRequest { window: 0x200001, parent: 0x1d3 }".  Cut off to fit size and
+// always NUL terminated, returns the length written.  Doesn't allocate, so
+// it's cheap enough to trace every event.
+extern size_t FormatEvent(const XEvent& xev, char* buffer, size_t size);
 
 extern std::string XConfigureWindowValueMaskToString(unsigned long value_mask);
 
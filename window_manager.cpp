@@ -1,47 +1,81 @@
 extern "C"
 {
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
 }
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <glog/logging.h>
 #include "window_manager.hpp"
+#include "xlib_backend.hpp"
 #include "util.hpp"
 
-bool WindowManager::wm_detected_;
-std::mutex WindowManager::wm_detected_mutex_;
+namespace
+{
+  // frame geometry including the border on both sides
+  Rect<int> OuterRect(int x, int y, int width, int height, int border_width)
+  {
+    return Rect<int>(x, y, width + 2 * border_width, height + 2 * border_width);
+  }
+
+  // ms between event loop stats in the log
+  const uint64_t STATS_LOG_INTERVAL = 60 * 1000;
+
+  // events read into one batch at most, so a flood of motion can't hold off
+  // timers and pings
+  const size_t MAX_BATCH_SIZE = 256;
+}
 
-std::unique_ptr<WindowManager> WindowManager::Create(const std::string& disp_str)
+std::unique_ptr<WindowManager> WindowManager::Create(const std::string& disp_str,
+                                                     std::shared_ptr<const Config> config)
 {
-  const char* display_str = disp_str.empty() ? nullptr : disp_str.c_str();
-  Display* display = XOpenDisplay(display_str);
-  if(display == nullptr)
+  std::unique_ptr<XlibBackend> backend = XlibBackend::Open(disp_str);
+  if (!backend)
   {
-    LOG(ERROR) << "Failed to open X display" << XDisplayName(nullptr);
     return nullptr;
   }
 
-  return std::unique_ptr<WindowManager>(new WindowManager(display));
+  return Create(std::move(backend), std::move(config));
 }
 
-WindowManager::WindowManager(Display* display)
-    : display_(CHECK_NOTNULL(display)),
-      root_(DefaultRootWindow(display_)),
-      WM_PROTOCOLS(XInternAtom(display_, "WM_PROTOCOLS", false)),
-      WM_DELETE_WINDOW(XInternAtom(display_, "WM_DELETE_WINDOW", false))
+std::unique_ptr<WindowManager> WindowManager::Create(std::unique_ptr<DisplayBackend> backend,
+                                                     std::shared_ptr<const Config> config)
+{
+  return std::unique_ptr<WindowManager>(new WindowManager(std::move(backend), std::move(config)));
+}
 
+WindowManager::WindowManager(std::unique_ptr<DisplayBackend> backend, std::shared_ptr<const Config> config)
+    : x_(std::move(backend)),
+      config_(std::move(config)),
+      snapper_(CHECK_NOTNULL(config_.get())->snap_distance),
+      root_(CHECK_NOTNULL(x_.get())->Root()),
+      atoms_(x_.get()),
+      tracer_(config_->trace_latency ? new LatencyTracer() : nullptr),
+      batch_received_(0),
+      ewmh_(x_.get(), atoms_, root_),
+      stop_(false),
+      config_pending_(false),
+      timers_(x_->Now()),
+      timer_deadline_(0)
 {
 }
 
 WindowManager::~WindowManager()
 {
-  XCloseDisplay(display_);
 }
 
 void WindowManager::OnCreateNotify(const XCreateWindowEvent& e) { }
 
-void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e) { }
+void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e)
+{
+  // destroyed without an unmap first, i.e. while it was unmapped
+  if (clients_.count(e.window))
+  {
+    Unframe(e.window, true);
+  }
+}
 
 void WindowManager::OnReparentNotify(const XReparentEvent& e) { }
 
@@ -54,20 +88,46 @@ void WindowManager::OnUnmapNotify(const XUnmapEvent& e)
       LOG(INFO) << "Ignore unmap notify for non-client window" << e.window;
       return;
     }
-  if (e.event == root_)
+  if (e.event == root_ && !config_->frameless)
   {
     LOG(INFO) << "Ignore unmap notify for reparented window" << e.window;
     return;
   }
-  Unframe(e.window);
+  // the unmap of a window being destroyed comes first, with the window gone
+  Unframe(e.window, batch_.Destroys(e.window));
 }
 
-void WindowManager::OnConfigureNotify(const XConfigureEvent& e) { }
+void WindowManager::OnConfigureNotify(const XConfigureEvent& e)
+{
+  // keep track of where frames are for snapping
+  if (e.event != root_)
+  {
+    return;
+  }
+  if (tracer_)
+  {
+    tracer_->OnConfigureNotify(e.window, e.serial, batch_received_);
+  }
+  auto i = frame_geometry_.find(e.window);
+  if (i != frame_geometry_.end())
+  {
+    i->second = OuterRect(e.x, e.y, e.width, e.height, e.border_width);
+    if (state_export_)
+    {
+      state_export_->SetGeometry(e.window, i->second);
+    }
+  }
+}
 
 void WindowManager::OnMapRequest(const XMapRequestEvent& e)
 { 
-  Frame(e.window);
-  XMapWindow(display_, e.window);
+  // framed at startup while it was unmapped, otherwise framed now
+  if (!clients_.count(e.window))
+  {
+    Frame(e.window);
+  }
+  unmapped_frames_.erase(clients_[e.window]);
+  x_->MapWindow(e.window);
 }
 
 void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e)
@@ -80,14 +140,42 @@ void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e)
   wchanges.border_width = e.border_width;
   wchanges.sibling = e.above;
   wchanges.stack_mode = e.detail;
+  unsigned int value_mask = e.value_mask;
+  auto pending = pending_frames_.find(e.window);
+  if (pending != pending_frames_.end())
+  {
+    // mapped later in this batch, frame it where this puts it
+    XWindowAttributes& attributes = pending->second.attributes;
+    attributes.x = value_mask & CWX ? e.x : attributes.x;
+    attributes.y = value_mask & CWY ? e.y : attributes.y;
+    attributes.width = value_mask & CWWidth ? e.width : attributes.width;
+    attributes.height = value_mask & CWHeight ? e.height : attributes.height;
+    attributes.border_width = value_mask & CWBorderWidth ? e.border_width : attributes.border_width;
+  }
   if (clients_.count(e.window))
   {
     const Window frame = clients_[e.window];
-    XConfigureWindow(display_, frame, e.value_mask, &wchanges);
-    LOG(INFO) << "resize " << frame << "to" << Size<int>(e.width, e.height);
+    if (frame != e.window)
+    {
+      x_->ConfigureWindow(frame, e.value_mask, &wchanges);
+      LOG(INFO) << "resize " << frame << "to" << Size<int>(e.width, e.height);
+    }
+    else
+    {
+      // frameless, the border is ours
+      value_mask &= ~CWBorderWidth;
+    }
+
+    // ahead of its ConfigureNotify, for a drag starting in this batch
+    Rect<int>& rect = frame_geometry_[frame];
+    const int border_width = config_->border_width;
+    rect.x = value_mask & CWX ? e.x : rect.x;
+    rect.y = value_mask & CWY ? e.y : rect.y;
+    rect.width = value_mask & CWWidth ? e.width + 2 * border_width : rect.width;
+    rect.height = value_mask & CWHeight ? e.height + 2 * border_width : rect.height;
   }
 
-  XConfigureWindow(display_, e.window, e.value_mask, &wchanges);
+  x_->ConfigureWindow(e.window, value_mask, &wchanges);
   LOG(INFO) << "resize " << e.window << "to" << Size<int>(e.width, e.height);
 }
 
@@ -99,26 +187,38 @@ void WindowManager::OnButtonPress(const XButtonEvent& e)
   // save original cursor position 
   drag_start_pos_ = Position<int>(e.x_root, e.y_root);
 
-  // save window info
-  Window returned_root;
-  int x, y;
-  unsigned width, height, border_width, depth;
-  CHECK(XGetGeometry(
-        display_,
-        frame,
-        &returned_root,
-        &x,
-        &y,
-        &width,
-        &height,
-        &border_width,
-        &depth));
-
-  drag_start_frame_pos_ = Position<int>(x, y);
-  drag_start_frame_size_ = Size<int>(width, height);
+  // save window info, kept current by Frame(), configure and drags, so no
+  // round trip flushes the batch's requests halfway
+  auto geometry = frame_geometry_.find(frame);
+  CHECK(geometry != frame_geometry_.end());
+  const Rect<int>& rect = geometry->second;
+  const int border_width = config_->border_width;
+  drag_start_frame_pos_ = Position<int>(rect.x, rect.y);
+  drag_start_frame_size_ = Size<int>(rect.width - 2 * border_width, rect.height - 2 * border_width);
+
+  // everything the frame can snap to while it's dragged
+  EdgeStore& edges = snapper_.edges();
+  edges.Clear();
+  edges.AddVerticalEdge(screen_.left());
+  edges.AddVerticalEdge(screen_.right());
+  edges.AddHorizontalEdge(screen_.top());
+  edges.AddHorizontalEdge(screen_.bottom());
+  for (const auto& other : frame_geometry_)
+  {
+    // only what is on screen
+    const Rect<int>& rect = other.second;
+    if (other.first != frame && !unmapped_frames_.count(other.first) &&
+        rect.right() > screen_.left() && rect.left() < screen_.right() &&
+        rect.bottom() > screen_.top() && rect.top() < screen_.bottom())
+    {
+      edges.AddRect(rect);
+    }
+  }
+  edges.Sort();
 
   // raised click window
-  XRaiseWindow(display_, frame);
+  x_->RaiseWindow(frame);
+  ewmh_.RaiseClient(e.window);
 }
 
 void WindowManager::OnButtonRelease(const XButtonEvent& e) { }
@@ -133,7 +233,19 @@ void WindowManager::OnMotionNotify(const XMotionEvent& e)
   if (e.state & Button1Mask)
   {
     const Position<int> dest_frame_pos = drag_start_frame_pos_ + delta;
-    XMoveWindow(display_, frame, dest_frame_pos.x, dest_frame_pos.y);
+    const Rect<int> dest = snapper_.SnapMove(OuterRect(
+        dest_frame_pos.x,
+        dest_frame_pos.y,
+        drag_start_frame_size_.width,
+        drag_start_frame_size_.height,
+        config_->border_width));
+    x_->MoveWindow(frame, dest.x, dest.y);
+    if (tracer_)
+    {
+      tracer_->BeginInput(e.time, batch_received_);
+      tracer_->Expect(INTERACTION_MOVE, frame, x_->LastRequestSerial());
+    }
+    frame_geometry_[frame] = dest;
   }
   else if (e.state & Button3Mask)
   {
@@ -142,273 +254,956 @@ void WindowManager::OnMotionNotify(const XMotionEvent& e)
         std::max(delta.x, -drag_start_frame_size_.width),
         std::max(delta.y, -drag_start_frame_size_.height));
     const Size<int> dest_frame_size = drag_start_frame_size_ + size_delta;
+    const Rect<int> dest = snapper_.SnapResize(OuterRect(
+        drag_start_frame_pos_.x,
+        drag_start_frame_pos_.y,
+        dest_frame_size.width,
+        dest_frame_size.height,
+        config_->border_width));
+    const int width = std::max(1, dest.width - 2 * static_cast<int>(config_->border_width));
+    const int height = std::max(1, dest.height - 2 * static_cast<int>(config_->border_width));
 
-    XResizeWindow(display_, frame, dest_frame_size.width, dest_frame_size.height);
-    XResizeWindow(display_, e.window, dest_frame_size.width, dest_frame_size.height);
+    x_->ResizeWindow(frame, width, height);
+    if (tracer_)
+    {
+      tracer_->BeginInput(e.time, batch_received_);
+      tracer_->Expect(INTERACTION_RESIZE, frame, x_->LastRequestSerial());
+    }
+    if (frame != e.window)
+    {
+      x_->ResizeWindow(e.window, width, height);
+    }
+    frame_geometry_[frame] = dest;
   } 
 }
 
 void WindowManager::OnKeyPress(const XKeyEvent& e)
 {
-  if ((e.state & Mod1Mask) && e.keycode == XKeysymToKeycode(display_, XK_F4))
+  if (tracer_)
   {
-    Atom* supported_protocols;
-    int num_supported_protocols;
-    if (XGetWMProtocols(display_, e.window, &supported_protocols, &num_supported_protocols) &&
-      (std::find(supported_protocols, supported_protocols + num_supported_protocols, WM_DELETE_WINDOW) !=
-        supported_protocols + num_supported_protocols))
+    tracer_->BeginInput(e.time, batch_received_);
+  }
+  for (const BoundKey& key : keys_)
+  {
+    if ((e.state & key.modifiers) == key.modifiers && e.keycode == key.keycode)
     {
-      LOG(INFO) << "Deleting window: " << e.window;
-      XEvent msg;
-      memset(&msg, 0, sizeof(msg));
-      msg.xclient.type = ClientMessage;
-      msg.xclient.message_type = WM_PROTOCOLS;
-      msg.xclient.window = e.window;
-      msg.xclient.format = 32;
-      msg.xclient.data.l[0] = WM_DELETE_WINDOW;
-
-      CHECK(XSendEvent(display_, e.window, false, 0, &msg));
+      switch (key.action)
+      {
+        case ACTION_CLOSE_WINDOW:
+          CloseWindow(e.window);
+          break;
+        case ACTION_NEXT_WINDOW:
+          FocusNextWindow(e.window);
+          break;
+      }
+      return;
     }
-    else
+  }
+}
+
+void WindowManager::CloseWindow(Window win)
+{
+  std::vector<Atom> supported_protocols;
+  const bool has_protocols = GetWMProtocols(win, &supported_protocols);
+  const auto supports = [&] (Atom protocol)
+  {
+    return has_protocols &&
+      std::find(supported_protocols.begin(), supported_protocols.end(), protocol) != supported_protocols.end();
+  };
+
+  PingState* ping = nullptr;
+  if (clients_.count(win))
+  {
+    ping = &pings_[win];
+    ping->supported = supports(atoms_[ATOM_NET_WM_PING]);
+    if (ping->supported && ping->unresponsive)
     {
-      LOG(INFO) << "killing window: " << e.window;
-      XKillClient(display_, e.window);
+      // second close of a client that let a ping time out and hasn't
+      // answered one since, don't wait for it any longer
+      LOG(INFO) << "killing unresponsive window: " << win;
+      x_->KillClient(win);
+      return;
     }
   }
-  else if ((e.state & Mod1Mask) && e.keycode == XKeysymToKeycode(display_, XK_Tab))
+
+  if (supports(atoms_[ATOM_WM_DELETE_WINDOW]))
+  {
+    LOG(INFO) << "Deleting window: " << win;
+    XEvent msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.xclient.type = ClientMessage;
+    msg.xclient.message_type = atoms_[ATOM_WM_PROTOCOLS];
+    msg.xclient.window = win;
+    msg.xclient.format = 32;
+    msg.xclient.data.l[0] = atoms_[ATOM_WM_DELETE_WINDOW];
+
+    CHECK(x_->SendEvent(win, false, 0, &msg));
+
+    // find out whether it's actually going to do anything about it
+    if (ping && ping->supported)
+    {
+      Ping(win);
+    }
+  }
+  else
+  {
+    LOG(INFO) << "killing window: " << win;
+    x_->KillClient(win);
+  }
+}
+
+void WindowManager::FocusNextWindow(Window win)
+{
+  // we're alt-tabbing
+ //find next window
+  auto i = clients_.find(win);
+  CHECK(i != clients_.end());
+  for (size_t n = 0; n < clients_.size(); ++n)
   {
-    // we're alt-tabbing
-   //find next window
-    auto i = clients_.find(e.window);
-    CHECK(i != clients_.end());
     ++i;
     if (i == clients_.end())
     {
       i = clients_.begin();
     }
+    if (!SkipsAltTab(i->first))
+    {
+      break;
+    }
+  }
+  if (SkipsAltTab(i->first))
+  {
+    // nothing to tab to
+    return;
+  }
+
+  //raise and focus on
+  x_->RaiseWindow(i->second);
+  x_->SetInputFocus(i->first, RevertToPointerRoot, CurrentTime);
+  if (tracer_)
+  {
+    tracer_->Expect(INTERACTION_FOCUS, i->first, x_->LastRequestSerial());
+  }
+  ewmh_.RaiseClient(i->first);
+  ewmh_.SetActiveWindow(i->first);
+  if (state_export_)
+  {
+    state_export_->SetFocus(i->first);
+  }
+}
+
+void WindowManager::Ping(Window win)
+{
+  PingState& ping = pings_[win];
+  if (ping.deadline)
+  {
+    // one outstanding ping is enough
+    return;
+  }
+
+  // any increasing timestamp does, the client just echoes it
+  ping.timestamp = std::max<Time>(1, static_cast<uint32_t>(x_->Now()));
+  XEvent msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.xclient.type = ClientMessage;
+  msg.xclient.message_type = atoms_[ATOM_WM_PROTOCOLS];
+  msg.xclient.window = win;
+  msg.xclient.format = 32;
+  msg.xclient.data.l[0] = atoms_[ATOM_NET_WM_PING];
+  msg.xclient.data.l[1] = ping.timestamp;
+  msg.xclient.data.l[2] = win;
+  x_->SendEvent(win, false, NoEventMask, &msg);
+
+  ping.deadline = Schedule(config_->ping_timeout, [this, win] () { OnPingTimeout(win); });
+}
+
+void WindowManager::PingFocusedWindow()
+{
+  Schedule(config_->ping_interval, [this] () { PingFocusedWindow(); });
+
+  const Window win = ewmh_.active_window();
+  if (!clients_.count(win))
+  {
+    return;
+  }
+  auto inserted = pings_.emplace(win, PingState());
+  PingState& ping = inserted.first->second;
+  if (inserted.second)
+  {
+    // once per client, later pings use the cached answer
+    std::vector<Atom> protocols;
+    ping.supported = GetWMProtocols(win, &protocols) &&
+      std::find(protocols.begin(), protocols.end(), atoms_[ATOM_NET_WM_PING]) != protocols.end();
+  }
+  if (ping.supported)
+  {
+    Ping(win);
+  }
+}
+
+void WindowManager::OnPingTimeout(Window win)
+{
+  auto i = pings_.find(win);
+  if (i == pings_.end())
+  {
+    return;
+  }
+  PingState& ping = i->second;
+  ping.deadline = 0;
+  // only a full ping_timeout without a pong marks a client, whatever ran
+  // this timer
+  const uint32_t waited = static_cast<uint32_t>(x_->Now()) - static_cast<uint32_t>(ping.timestamp);
+  if (waited < config_->ping_timeout)
+  {
+    ping.deadline = Schedule(config_->ping_timeout - waited, [this, win] () { OnPingTimeout(win); });
+    return;
+  }
+  if (!ping.unresponsive)
+  {
+    LOG(WARNING) << "window " << win << " didn't answer a ping in " << config_->ping_timeout << "ms";
+    ping.unresponsive = true;
+    x_->SetWindowBorder(clients_[win], config_->unresponsive_border_color);
+    if (state_export_)
+    {
+      state_export_->SetUnresponsive(win, true);
+    }
+  }
+}
 
-    //raise and focus on
-    XRaiseWindow(display_, i->second);
-    XSetInputFocus(display_, i->first, RevertToPointerRoot, CurrentTime);
+void WindowManager::OnClientMessage(const XClientMessageEvent& e)
+{
+  if (e.window != root_ ||
+      e.message_type != atoms_[ATOM_WM_PROTOCOLS] ||
+      static_cast<Atom>(e.data.l[0]) != atoms_[ATOM_NET_WM_PING])
+  {
+    return;
+  }
+
+  // pong, a late one still proves the client is alive
+  const Window win = e.data.l[2];
+  auto i = pings_.find(win);
+  if (i == pings_.end() || i->second.timestamp != static_cast<Time>(e.data.l[1]))
+  {
+    return;
+  }
+  PingState& ping = i->second;
+  Cancel(ping.deadline);
+  ping.deadline = 0;
+  if (ping.unresponsive)
+  {
+    LOG(INFO) << "window " << win << " is responsive again";
+    ping.unresponsive = false;
+    x_->SetWindowBorder(clients_[win], config_->border_color);
+    if (state_export_)
+    {
+      state_export_->SetUnresponsive(win, false);
+    }
   }
 }
 
 void WindowManager::OnKeyRelease(const XKeyEvent& e) { }
 
+void WindowManager::OnFocusIn(const XFocusChangeEvent& e)
+{
+  // only selected while tracing
+  if (tracer_ && e.mode == NotifyNormal)
+  {
+    tracer_->OnFocusIn(e.window, e.serial, batch_received_);
+  }
+}
+
+void WindowManager::OnPropertyNotify(const XPropertyEvent& e)
+{
+  if (!prefetcher_ || !clients_.count(e.window))
+  {
+    return;
+  }
+  if (e.atom == atoms_[ATOM_WM_PROTOCOLS])
+  {
+    // CloseWindow() must not go by the old protocols, it reads them itself
+    // until the refetch is in
+    client_properties_.erase(e.window);
+  }
+  else if (e.atom != XA_WM_NAME && e.atom != atoms_[ATOM_NET_WM_NAME] && e.atom != atoms_[ATOM_NET_WM_ICON])
+  {
+    return;
+  }
+  stale_properties_.insert(e.window);
+}
+
 void WindowManager::Run()
 {
-  // Select events on root window.  Use a special error handler
-  // so we can exit gracefully if another wm is running
-  std::lock_guard <std::mutex> lock(wm_detected_mutex_);
+  if (!Init())
+  {
+    return;
+  }
+
+  RunEventLoop();
+}
 
-  wm_detected_ = false;
-  XSetErrorHandler(&WindowManager::OnWMDetected);
-  XSelectInput(display_, root_, SubstructureRedirectMask | SubstructureNotifyMask);
-  XSync(display_, false);
-  if(wm_detected_)
+void WindowManager::RunEventLoop()
+{
+  // 2. Main event loop
+  while (!stop_)
+  {
+    ProcessBatch();
+  }
+
+  if (tracer_)
+  {
+    LOG(INFO) << tracer_->Report();
+  }
+}
+
+void WindowManager::Stop()
+{
+  stop_ = true;
+  x_->Wakeup();
+}
+
+void WindowManager::Reconfigure(std::shared_ptr<const Config> config)
+{
+  CHECK_NOTNULL(config.get());
+  // a newer config replaces one that wasn't applied yet
+  std::atomic_store(&pending_config_, std::move(config));
+  config_pending_ = true;
+  x_->Wakeup();
+}
+
+void WindowManager::ApplyConfig(std::shared_ptr<const Config> config)
+{
+  if (!config)
   {
-    LOG(ERROR) << "Another window manager is running on display "
-               << XDisplayString(display_);
     return;
   }
-  // set error handler
-  XSetErrorHandler(&WindowManager::OnXError);
+  const std::shared_ptr<const Config> old = config_;
+  if (config->frameless != old->frameless ||
+      config->trace_latency != old->trace_latency ||
+      config->export_state != old->export_state ||
+      config->prefetch != old->prefetch)
+  {
+    LOG(WARNING) << "frameless, trace_latency, export_state and prefetch only change on restart";
+    std::shared_ptr<Config> startup = std::make_shared<Config>(*config);
+    startup->frameless = old->frameless;
+    startup->trace_latency = old->trace_latency;
+    startup->export_state = old->export_state;
+    startup->prefetch = old->prefetch;
+    config = startup;
+  }
+  config_ = config;
+
+  // Only what changed is sent.  Frames report their new geometry through
+  // ConfigureNotify.  Background color and rules apply to new windows.
+  if (config->border_width != old->border_width)
+  {
+    XWindowChanges wchanges;
+    wchanges.border_width = config->border_width;
+    for (const auto& client : clients_)
+    {
+      x_->ConfigureWindow(client.second, CWBorderWidth, &wchanges);
+    }
+  }
+  if (config->border_color != old->border_color ||
+      config->unresponsive_border_color != old->unresponsive_border_color)
+  {
+    for (const auto& client : clients_)
+    {
+      auto ping = pings_.find(client.first);
+      const bool unresponsive = ping != pings_.end() && ping->second.unresponsive;
+      const unsigned long color = unresponsive ? config->unresponsive_border_color : config->border_color;
+      if (color != (unresponsive ? old->unresponsive_border_color : old->border_color))
+      {
+        x_->SetWindowBorder(client.second, color);
+      }
+    }
+  }
+  if (config->snap_distance != old->snap_distance)
+  {
+    snapper_.set_distance(config->snap_distance);
+  }
+  if (config->key_bindings != old->key_bindings)
+  {
+    for (const auto& client : clients_)
+    {
+      for (const BoundKey& key : keys_)
+      {
+        x_->UngrabKey(key.keycode, key.modifiers, client.first);
+      }
+    }
+    BindKeys();
+    for (const auto& client : clients_)
+    {
+      for (const BoundKey& key : keys_)
+      {
+        x_->GrabKey(key.keycode, key.modifiers, client.first, false);
+      }
+    }
+  }
+  LOG(INFO) << "Applied new config to display " << x_->Name();
+}
+
+void WindowManager::BindKeys()
+{
+  // keycodes differ between displays
+  keys_.clear();
+  for (const KeyBinding& binding : config_->key_bindings)
+  {
+    keys_.push_back(BoundKey{binding.modifiers, x_->KeysymToKeycode(binding.keysym), binding.action});
+  }
+}
+
+bool WindowManager::Init()
+{
+  // Select events on root window, fails if another wm is running
+  if (!x_->SelectRootInput(SubstructureRedirectMask | SubstructureNotifyMask))
+  {
+    LOG(ERROR) << "Another window manager is running on display "
+               << x_->Name();
+    return false;
+  }
+  // only now, the segment of a running instance has the same name
+  if (config_->export_state)
+  {
+    state_export_ = StateExport::Create(SharedStateName(x_->Name()));
+  }
+  ewmh_.Init();
+
+  // before framing, so existing windows are prefetched too
+  if (config_->prefetch)
+  {
+    prefetcher_ = Prefetcher::Start(x_->OpenConnection(), [this] () { x_->Wakeup(); });
+  }
+
+  BindKeys();
+
+  int x, y;
+  unsigned int width, height, border_width;
+  CHECK(x_->GetGeometry(root_, &x, &y, &width, &height, &border_width));
+  screen_ = Rect<int>(0, 0, width, height);
   
   // grab x to prevent windows from changing under us
-  XGrabServer(display_);
+  x_->GrabServer();
 
   // reparent and query top level windows
-  Window returned_root, returned_parent;
-  Window* top_level_windows;
-  unsigned int num_top_level_windows;
-  CHECK(XQueryTree(display_, root_, &returned_root, &returned_parent, &top_level_windows, &num_top_level_windows));
+  std::vector<Window> top_level_windows;
+  CHECK(x_->QueryTree(root_, &top_level_windows));
 
-  for (unsigned int i = 0; i < num_top_level_windows; ++i)
+  for (const Window win : top_level_windows)
   {
-    Frame(top_level_windows[i]);
+    if (win != ewmh_.check_window())
+    {
+      Frame(win);
+    }
   }
   
-  XFree(top_level_windows);
-  XUngrabServer(display_);
-  // 2. Main event loop
-  for (;;)
+  ewmh_.Flush();
+  x_->UngrabServer();
+  x_->Flush();
+
+  Schedule(STATS_LOG_INTERVAL, [this] () { LogStats(); });
+  Schedule(config_->ping_interval, [this] () { PingFocusedWindow(); });
+  return true;
+}
+
+void WindowManager::ProcessBatch()
+{
+  if (x_->WaitForEvents())
   {
-    // Get next event
-    XEvent xev;
-    XNextEvent(display_, &xev); 
-    LOG(INFO) << "Received event: " << ToString(xev.type);
+    HandleBatch();
+  }
+  // otherwise woken up by Stop(), Reconfigure(), the prefetcher or the timer
 
-    switch (xev.type)
+  if (prefetcher_)
+  {
+    RefreshProperties();
+    TakePrefetched();
+  }
+
+  if (config_pending_.exchange(false))
+  {
+    ApplyConfig(std::atomic_exchange(&pending_config_, std::shared_ptr<const Config>()));
+  }
+
+  // timers run between batches, never in the middle of one
+  RunTimers();
+
+  // publish whatever the handlers changed
+  ewmh_.Flush();
+  if (state_export_)
+  {
+    state_export_->Publish();
+  }
+  x_->Flush();
+}
+
+void WindowManager::HandleBatch()
+{
+  // Drain what has already arrived into the batch, up to MAX_BATCH_SIZE.
+  // Reading doesn't flush, the batch's requests go out in a single flush
+  // after all handlers ran.  Closing a client whose WM_PROTOCOLS weren't
+  // prefetched is the exception, it reads them halfway.
+  batch_.Clear();
+  XEvent xev;
+  while (batch_.size() < MAX_BATCH_SIZE && x_->EventsQueued() > 0)
+  {
+    x_->NextEvent(&xev);
+    batch_.Add(xev);
+  }
+  const size_t received = batch_.size();
+  if (tracer_)
+  {
+    batch_received_ = LatencyTracer::NowMicros();
+  }
+
+  batch_.Coalesce(clients_);
+
+  // framing reads from the server, before the handlers queue anything
+  pending_frames_.clear();
+  for (const XEvent& e : batch_)
+  {
+    if (e.type == MapRequest && !clients_.count(e.xmaprequest.window) &&
+        !pending_frames_.count(e.xmaprequest.window))
     {
-      case CreateNotify:
-        OnCreateNotify(xev.xcreatewindow);
-        break;
-      case DestroyNotify:
-        OnDestroyNotify(xev.xdestroywindow);
-        break;
-      case ReparentNotify:
-        OnReparentNotify(xev.xreparent);
-        break;
-      case MapNotify:
-        OnMapNotify(xev.xmap);
-        break;
-      case UnmapNotify:
-        OnUnmapNotify(xev.xunmap);
-        break;
-      case ConfigureNotify:
-        OnConfigureNotify(xev.xconfigure);
-        break;
-      case MapRequest:
-        OnMapRequest(xev.xmaprequest);
-        break;
-      case ConfigureRequest:
-        OnConfigureRequest(xev.xconfigurerequest);
-        break;
-      case ButtonPress:
-        OnButtonPress(xev.xbutton);
-        break;
-      case ButtonRelease:
-        OnButtonRelease(xev.xbutton);
-        break;
-      case MotionNotify:
-        while (XCheckTypedWindowEvent(display_, xev.xmotion.window, MotionNotify, &xev)) {}
-        OnMotionNotify(xev.xmotion);
-        break;
-      case KeyPress:
-        OnKeyPress(xev.xkey);
-        break;
-      case KeyRelease:
-        OnKeyRelease(xev.xkey);
-        break;
-      default:
-        LOG(WARNING) << "Unhandled event";
+      PrepareFrame(e.xmaprequest.window);
     }
   }
+
+  for (const XEvent& e : batch_)
+  {
+    HandleEvent(e);
+  }
+
+  ++stats_.batches;
+  stats_.events_received += received;
+  stats_.events_dispatched += batch_.size();
+  stats_.last_batch_size = received;
+  stats_.max_batch_size = std::max(stats_.max_batch_size, received);
+  VLOG(2) << "Batch of " << received << " events, dispatched " << batch_.size()
+          << " (" << stats_.ToString() << ")";
+}
+
+TimerId WindowManager::Schedule(uint64_t delay, TimerWheel::Callback callback)
+{
+  // the wheel's time only moves in RunTimers(), after the batch, so a handler
+  // running after a long wait would schedule relative to a stale now
+  return timers_.ScheduleAt(x_->Now() + delay, std::move(callback));
+}
+
+bool WindowManager::Cancel(TimerId id)
+{
+  return timers_.Cancel(id);
+}
+
+void WindowManager::RunTimers()
+{
+  timers_.Advance(x_->Now());
+
+  // every rearm is a syscall, skip it if the deadline didn't move
+  const uint64_t deadline = timers_.NextExpiry();
+  if (deadline != timer_deadline_)
+  {
+    x_->SetTimer(deadline);
+    timer_deadline_ = deadline;
+  }
+}
+
+void WindowManager::RequestPrefetch(Window win)
+{
+  const uint64_t generation = next_prefetch_generation_++;
+  if (!prefetcher_->Request(win, generation))
+  {
+    LOG(WARNING) << "prefetch queue full, window " << win << " is fetched on demand";
+    return;
+  }
+  prefetch_generations_[win] = generation;
+}
+
+void WindowManager::RefreshProperties()
+{
+  for (const Window win : stale_properties_)
+  {
+    if (clients_.count(win))
+    {
+      RequestPrefetch(win);
+    }
+  }
+  stale_properties_.clear();
+}
+
+void WindowManager::TakePrefetched()
+{
+  std::unique_ptr<ClientProperties> properties;
+  while (prefetcher_->TakeResult(&properties))
+  {
+    const Window win = properties->win;
+    auto pending = prefetch_generations_.find(win);
+    if (pending == prefetch_generations_.end())
+    {
+      // unframed in the meantime
+      continue;
+    }
+    if (pending->second != properties->generation)
+    {
+      // fetched before a property changed, or for an earlier client with
+      // the same window id, the last request's result is on its way
+      continue;
+    }
+    prefetch_generations_.erase(pending);
+    VLOG(1) << "prefetched " << win << ": \"" << properties->title << "\", "
+            << properties->protocols.size() << " protocols, icon "
+            << properties->icon_width << "x" << properties->icon_height;
+    auto ping = pings_.find(win);
+    if (ping != pings_.end())
+    {
+      // WM_PROTOCOLS may have changed since the ping state cached it
+      ping->second.supported = properties->has_protocols &&
+        std::find(properties->protocols.begin(), properties->protocols.end(), atoms_[ATOM_NET_WM_PING]) !=
+          properties->protocols.end();
+    }
+    client_properties_[win] = std::move(properties);
+  }
+}
+
+const ClientProperties* WindowManager::client_properties(Window win) const
+{
+  auto i = client_properties_.find(win);
+  return i == client_properties_.end() ? nullptr : i->second.get();
+}
+
+bool WindowManager::GetWMProtocols(Window win, std::vector<Atom>* protocols)
+{
+  const ClientProperties* properties = client_properties(win);
+  if (properties == nullptr)
+  {
+    // not prefetched (yet), a round trip
+    return x_->GetWMProtocols(win, protocols);
+  }
+  *protocols = properties->protocols;
+  return properties->has_protocols;
+}
+
+void WindowManager::LogStats()
+{
+  VLOG(1) << "Event loop: " << stats_.ToString();
+  if (!config_->rules->empty())
+  {
+    VLOG(1) << "Rules: " << rule_stats_.ToString();
+  }
+  if (tracer_)
+  {
+    LOG(INFO) << tracer_->Report();
+  }
+  Schedule(STATS_LOG_INTERVAL, [this] () { LogStats(); });
+}
+
+void WindowManager::HandleEvent(const XEvent& xev)
+{
+  // every event goes through here, only pay for formatting when it's logged
+  if (VLOG_IS_ON(1))
+  {
+    char description[EVENT_DESCRIPTION_SIZE];
+    FormatEvent(xev, description, sizeof(description));
+    VLOG(1) << "Received event: " << description;
+  }
+
+  switch (xev.type)
+  {
+    case CreateNotify:
+      OnCreateNotify(xev.xcreatewindow);
+      break;
+    case DestroyNotify:
+      OnDestroyNotify(xev.xdestroywindow);
+      break;
+    case ReparentNotify:
+      OnReparentNotify(xev.xreparent);
+      break;
+    case MapNotify:
+      OnMapNotify(xev.xmap);
+      break;
+    case UnmapNotify:
+      OnUnmapNotify(xev.xunmap);
+      break;
+    case ConfigureNotify:
+      OnConfigureNotify(xev.xconfigure);
+      break;
+    case MapRequest:
+      OnMapRequest(xev.xmaprequest);
+      break;
+    case ConfigureRequest:
+      OnConfigureRequest(xev.xconfigurerequest);
+      break;
+    case ButtonPress:
+      OnButtonPress(xev.xbutton);
+      break;
+    case ButtonRelease:
+      OnButtonRelease(xev.xbutton);
+      break;
+    case MotionNotify:
+      // already compressed by EventBatch::Coalesce()
+      OnMotionNotify(xev.xmotion);
+      break;
+    case KeyPress:
+      OnKeyPress(xev.xkey);
+      break;
+    case KeyRelease:
+      OnKeyRelease(xev.xkey);
+      break;
+    case ClientMessage:
+      OnClientMessage(xev.xclient);
+      break;
+    case FocusIn:
+      OnFocusIn(xev.xfocus);
+      break;
+    case FocusOut:
+      // selected along with FocusIn while tracing, nothing to do
+      break;
+    case PropertyNotify:
+      OnPropertyNotify(xev.xproperty);
+      break;
+    default:
+      LOG(WARNING) << "Unhandled event";
+  }
+}
+
+void WindowManager::PrepareFrame(Window win)
+{
+  FrameInfo& info = pending_frames_[win];
+  CHECK(x_->GetWindowAttributes(win, &info.attributes));
+  info.has_rules = !config_->rules->empty();
+  if (info.has_rules)
+  {
+    info.actions = MatchRules(win);
+  }
 }
 
 void WindowManager::Frame(Window win) 
 {
-  const unsigned int BORDER_WIDTH = 3;
-  const unsigned long BORDER_COLOR = 0xff0000;
-  const unsigned long BG_COLOR = 0x0000ff;
-  
   CHECK(!clients_.count(win));
 
-  XWindowAttributes x_window_attrs;
-  CHECK(XGetWindowAttributes(display_, win, &x_window_attrs));
+  auto pending = pending_frames_.find(win);
+  if (pending == pending_frames_.end())
+  {
+    // at startup, outside of a batch
+    PrepareFrame(win);
+    pending = pending_frames_.find(win);
+  }
+  const FrameInfo info = pending->second;
+  pending_frames_.erase(pending);
+  XWindowAttributes x_window_attrs = info.attributes;
 
-  const Window frame = XCreateSimpleWindow(
-      display_,
-      root_,
-      x_window_attrs.x,
-      x_window_attrs.y,
-      x_window_attrs.height,
-      x_window_attrs.width,
-      BORDER_WIDTH,
-      BORDER_COLOR,
-      BG_COLOR);
-
-  // select events on frame
-  XSelectInput(display_, frame, SubstructureRedirectMask | SubstructureNotifyMask);
-  //save so restored in case of crash
-  XAddToSaveSet(display_, win);
+  if (info.has_rules)
+  {
+    const RuleActions& actions = info.actions;
+    if (actions.width > 0)
+    {
+      x_window_attrs.width = actions.width;
+      x_window_attrs.height = actions.height;
+      x_->ResizeWindow(win, actions.width, actions.height);
+    }
+    client_rules_[win] = actions;
+  }
+
+  Window frame;
+  if (config_->frameless)
+  {
+    // client borders only, everything else is applied to the client itself
+    original_border_width_[win] = x_window_attrs.border_width;
+    XWindowChanges wchanges;
+    wchanges.border_width = config_->border_width;
+    x_->ConfigureWindow(win, CWBorderWidth, &wchanges);
+    x_->SetWindowBorder(win, config_->border_color);
+    frame = win;
+  }
+  else
+  {
+    frame = x_->CreateSimpleWindow(
+        root_,
+        x_window_attrs.x,
+        x_window_attrs.y,
+        x_window_attrs.width,
+        x_window_attrs.height,
+        config_->border_width,
+        config_->border_color,
+        config_->background_color);
+
+    // select events on frame
+    x_->SelectInput(frame, SubstructureRedirectMask | SubstructureNotifyMask);
+    //save so restored in case of crash
+    x_->AddToSaveSet(win);
   
-  XReparentWindow(display_, win, frame, 0, 0);
+    x_->ReparentWindow(win, frame, 0, 0);
 
-  XMapWindow(display_, frame);
+    x_->MapWindow(frame);
+  }
 
   clients_[win] = frame;
+  if (x_window_attrs.map_state == IsUnmapped)
+  {
+    // until OnMapRequest() maps it, right after this for new windows
+    unmapped_frames_.insert(frame);
+  }
+  frame_geometry_[frame] = OuterRect(
+      x_window_attrs.x,
+      x_window_attrs.y,
+      x_window_attrs.width,
+      x_window_attrs.height,
+      config_->border_width);
+  ewmh_.AddClient(win);
+  if (state_export_)
+  {
+    auto rules = client_rules_.find(win);
+    state_export_->AddClient(win, frame, frame_geometry_[frame],
+                             rules == client_rules_.end() ? -1 : rules->second.workspace);
+  }
+  if (prefetcher_)
+  {
+    RequestPrefetch(win);
+  }
+
+  // property changes keep the prefetched ones current, FocusIn tells when
+  // alt+tab took effect
+  x_->SelectInput(win, PropertyChangeMask | (tracer_ ? FocusChangeMask : NoEventMask));
 
   // grab window manage actions on client window
   // move windows with alt and left mouse
-  XGrabButton(
-      display_,
+  x_->GrabButton(
       Button1,
       Mod1Mask,
       win,
       false,
-      ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
-      GrabModeAsync,
-      GrabModeAsync,
-      None,
-      None);
+      ButtonPressMask | ButtonReleaseMask | ButtonMotionMask);
 
   // alt + right click for resize
-  XGrabButton(
-      display_,
+  x_->GrabButton(
       Button3,
       Mod1Mask,
       win,
       false,
-      ButtonPressMask | ButtonPressMask | ButtonMotionMask,
-      GrabModeAsync,
-      GrabModeAsync,
-      None,
-      None);
-
-  XGrabKey(
-      display_,
-      XKeysymToKeycode(display_, XK_F4),
-      Mod1Mask,
-      win,
-      false,
-      GrabModeAsync, 
-      GrabModeAsync);
-  // switch with alt+tab
-  XGrabKey(
-      display_,
-      XKeysymToKeycode(display_, XK_Tab),
-      Mod1Mask,
-      win,
-      false,
-      GrabModeAsync,
-      GrabModeAsync);
+      ButtonPressMask | ButtonPressMask | ButtonMotionMask);
+
+  // key bindings, alt+F4 and alt+tab by default
+  for (const BoundKey& key : keys_)
+  {
+    x_->GrabKey(
+        key.keycode,
+        key.modifiers,
+        win,
+        false);
+  }
   LOG(INFO) << "framed window: " << win; 
 }
 
-void WindowManager::Unframe(Window win)
+RuleActions WindowManager::MatchRules(Window win)
+{
+  // a round trip each, only for what some rule looks at
+  const RuleSet& rules = *config_->rules;
+  WindowProperties properties;
+  // WM_CLASS is "instance\0class\0"
+  std::string wm_class;
+  if (rules.uses_class() && x_->GetStringProperty(win, XA_WM_CLASS, &wm_class))
+  {
+    const size_t end = wm_class.find('\0');
+    properties.instance = wm_class.substr(0, end);
+    if (end != std::string::npos)
+    {
+      properties.wm_class = wm_class.substr(end + 1, wm_class.find('\0', end + 1) - end - 1);
+    }
+  }
+  if (rules.uses_role())
+  {
+    x_->GetStringProperty(win, atoms_[ATOM_WM_WINDOW_ROLE], &properties.role);
+  }
+  if (rules.uses_title() && !x_->GetStringProperty(win, atoms_[ATOM_NET_WM_NAME], &properties.title))
+  {
+    x_->GetStringProperty(win, XA_WM_NAME, &properties.title);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const RuleActions actions = rules.Match(properties);
+  rule_stats_.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count());
+
+  VLOG(1) << "rules for " << win << " (" << properties.instance << ", " << properties.wm_class << ", "
+          << properties.role << ", " << properties.title << "): workspace " << actions.workspace
+          << ", layout " << actions.layout << ", size " << Size<int>(actions.width, actions.height)
+          << ", no focus " << actions.no_focus << ", skip alt+tab " << actions.skip_alt_tab;
+  return actions;
+}
+
+bool WindowManager::SkipsAltTab(Window win) const
+{
+  auto i = client_rules_.find(win);
+  return i != client_rules_.end() && (i->second.skip_alt_tab || i->second.no_focus);
+}
+
+void WindowManager::Unframe(Window win, bool destroyed)
 {
   CHECK(clients_.count(win));
 
   // reverse steps taken in frame
   const Window frame = clients_[win];
-  XUnmapWindow(display_, frame);
+  if (frame != win)
+  {
+    x_->UnmapWindow(frame);
 
-  XReparentWindow(
-      display_,
-      win,
-      root_,
-      0,
-      0);
+    // a destroyed client already left the save set
+    if (!destroyed)
+    {
+      x_->ReparentWindow(
+          win,
+          root_,
+          0,
+          0);
 
-  XRemoveFromSaveSet(display_, win);
-  XDestroyWindow(display_, frame);
+      x_->RemoveFromSaveSet(win);
+    }
+    x_->DestroyWindow(frame);
+  }
+  else if (!destroyed)
+  {
+    XWindowChanges wchanges;
+    wchanges.border_width = original_border_width_[win];
+    x_->ConfigureWindow(win, CWBorderWidth, &wchanges);
+  }
+  original_border_width_.erase(win);
+
+  if (!destroyed)
+  {
+    // a withdrawn client may live on, e.g. to be mapped again or managed by
+    // another window manager
+    x_->SelectInput(win, NoEventMask);
+    x_->UngrabButton(Button1, Mod1Mask, win);
+    x_->UngrabButton(Button3, Mod1Mask, win);
+    for (const BoundKey& key : keys_)
+    {
+      x_->UngrabKey(key.keycode, key.modifiers, win);
+    }
+  }
+
+  auto ping = pings_.find(win);
+  if (ping != pings_.end())
+  {
+    Cancel(ping->second.deadline);
+    pings_.erase(ping);
+  }
+
+  if (tracer_)
+  {
+    tracer_->Forget(win);
+    tracer_->Forget(frame);
+  }
 
   clients_.erase(win);
+  client_rules_.erase(win);
+  client_properties_.erase(win);
+  prefetch_generations_.erase(win);
+  stale_properties_.erase(win);
+  frame_geometry_.erase(frame);
+  unmapped_frames_.erase(frame);
+  ewmh_.RemoveClient(win);
+  if (state_export_)
+  {
+    state_export_->RemoveClient(win);
+  }
 
   LOG(INFO) << "unframed window: " << win;
 }
-
-int WindowManager::OnXError(Display* display, XErrorEvent* e)
-{
-  const int MAX_ERR_LEN = 1024;
-  char ERR_TXT[MAX_ERR_LEN];
-  XGetErrorText(display, e->error_code, ERR_TXT, sizeof(ERR_TXT));
-  LOG(ERROR) << "Received X error:\n"
-             << "    Request: " << int(e->request_code)
-             << " - " << XRequestCodeToString(e->request_code) << "\n"
-             << "    Error code: " << int(e->error_code)
-             << " - " << ERR_TXT << "\n"
-             << "    Resource ID: " << e->resourceid;
-    // The return value is ignored.
-    //   return 0;
-}
-int WindowManager::OnWMDetected(Display* display, XErrorEvent* e)
-{
-  // in the case of another wm, the error code from XSelectInput
-  // is BadAccess.  We don't expect this handler to receive any other 
-  // errors.
-  CHECK_EQ(static_cast<int>(e->error_code), BadAccess);
-  wm_detected_ = true;
-  return 0;
-}
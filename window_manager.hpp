@@ -5,37 +5,163 @@ extern "C"
 {
 #include <X11/Xlib.h>
 }
+#include <atomic>
 #include <memory>
-#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <vector>
 
+#include "atoms.hpp"
+#include "config.hpp"
+#include "display_backend.hpp"
+#include "event_batch.hpp"
+#include "ewmh.hpp"
+#include "latency_tracer.hpp"
+#include "prefetcher.hpp"
+#include "snap.hpp"
+#include "state_export.hpp"
+#include "timer_wheel.hpp"
 #include "util.hpp"
 
 class WindowManager
 {
   public:
     // Factory method for connecting to xserver and getting windowmanager instance
-    static std::unique_ptr<WindowManager> Create(const std::string& disp_str = std::string());
+    static std::unique_ptr<WindowManager> Create(
+        const std::string& disp_str = std::string(),
+        std::shared_ptr<const Config> config = DefaultConfig());
+
+    // Factory method for running on top of an arbitrary backend, e.g. FakeBackend
+    static std::unique_ptr<WindowManager> Create(
+        std::unique_ptr<DisplayBackend> backend,
+        std::shared_ptr<const Config> config = DefaultConfig());
 
     // Disconnects from xserver
     ~WindowManager();
 
-    // Entry point to class
+    // Entry point to class, Init() followed by RunEventLoop()
     void Run();
 
+    // Processes batches until Stop() is called
+    void RunEventLoop();
+
+    // Makes Run() return after the current batch, may be called from any thread
+    void Stop();
+
+    // Switches to config between two batches, may be called from any
+    // thread.  Borders, snapping and key bindings of existing windows are
+    // updated, background color and rules apply to windows mapped from
+    // then on.  Config::frameless and Config::trace_latency are kept.
+    void Reconfigure(std::shared_ptr<const Config> config);
+
+    // Takes over the display and frames existing windows.  Returns false if
+    // another window manager is running.  Called by Run().
+    bool Init();
+
+    // Blocks for events and handles everything that is queued as one batch.
+    // Due timers run afterwards.
+    // One iteration of the event loop in Run().
+    void ProcessBatch();
+
+    // Batching counters of the event loop
+    const EventLoopStats& event_loop_stats() const { return stats_; }
+
+    // Time spent matching rules on map
+    const RuleStats& rule_stats() const { return rule_stats_; }
+
+    // What the prefetcher fetched for a client, nullptr until it's done
+    const ClientProperties* client_properties(Window win) const;
+
+    // Runs callback on the event loop thread delay ms from now
+    TimerId Schedule(uint64_t delay, TimerWheel::Callback callback);
+    // Returns false if the timer already ran or was cancelled
+    bool Cancel(TimerId id);
+
  private:
     // Invoked by Create()
-    WindowManager(Display* display);
+    WindowManager(std::unique_ptr<DisplayBackend> backend, std::shared_ptr<const Config> config);
 
-   // Underlying display struct
-    Display* display_;
+   // Underlying display connection
+    std::unique_ptr<DisplayBackend> x_;
 
-    // fames a top level window
+    // Settings, shared with the other instances in this process
+    std::shared_ptr<const Config> config_;
+
+    // A key binding resolved to this display's keycodes
+    struct BoundKey
+    {
+      unsigned int modifiers;
+      KeyCode keycode;
+      Action action;
+    };
+    std::vector<BoundKey> keys_;
+    // Resolves config_->key_bindings into keys_
+    void BindKeys();
+
+    // Applies what differs between config_ and config, called by
+    // ProcessBatch() after Reconfigure()
+    void ApplyConfig(std::shared_ptr<const Config> config);
+
+    // What Frame() reads from the server about a window
+    struct FrameInfo
+    {
+      XWindowAttributes attributes;
+      // whether Config::rules were matched
+      bool has_rules;
+      RuleActions actions;
+    };
+    // Reads win's FrameInfo into pending_frames_, a round trip or more
+    void PrepareFrame(Window win);
+
+    // fames a top level window, or just decorates it with a border when
+    // Config::frameless is set
     void Frame(Window win);
 
-    // Unframes a client window
-    void Unframe(Window win);
+    // Unframes a client window.  destroyed skips the requests that would
+    // only fail on a window that is gone.
+    void Unframe(Window win, bool destroyed);
+
+    // Fetches what rules match on and evaluates Config::rules, one
+    // evaluation per map
+    RuleActions MatchRules(Window win);
+    // Whether alt+tab passes win by
+    bool SkipsAltTab(Window win) const;
+
+    // Drains the event queue into batch_ and handles it
+    void HandleBatch();
+
+    // Dispatches a single event to its handler
+    void HandleEvent(const XEvent& xev);
+
+    // Runs due timers and rearms the backend timer for the next one
+    void RunTimers();
+
+
+    // Queues win for (re)fetching under a new generation
+    void RequestPrefetch(Window win);
+    // Requests a refetch of every client in stale_properties_
+    void RefreshProperties();
+    // Stores what the prefetcher fetched since the last call, results a
+    // later request supersedes are dropped
+    void TakePrefetched();
+
+    // WM_PROTOCOLS of a client, prefetched ones if they arrived already
+    bool GetWMProtocols(Window win, std::vector<Atom>* protocols);
+
+    // Logs event loop stats every STATS_LOG_INTERVAL ms
+    void LogStats();
+
+    // key binding actions
+    void CloseWindow(Window win);
+    void FocusNextWindow(Window win);
+
+    // _NET_WM_PING, replies arrive as ClientMessages on the root window.
+    // Nothing ever waits for one, a timer marks the client unresponsive
+    // when the deadline passes.
+    void Ping(Window win);
+    void PingFocusedWindow();
+    void OnPingTimeout(Window win);
 
     // event handlers
     void OnCreateNotify(const XCreateWindowEvent& e);
@@ -51,35 +177,104 @@ class WindowManager
     void OnMotionNotify(const XMotionEvent& e);
     void OnKeyPress(const XKeyEvent& e);
     void OnKeyRelease(const XKeyEvent& e);
+    void OnClientMessage(const XClientMessageEvent& e);
+    void OnFocusIn(const XFocusChangeEvent& e);
+    void OnPropertyNotify(const XPropertyEvent& e);
 
-    
-    // Xlib error handler
-    static int OnXError(Display* display, XErrorEvent* e);
-
-    // Xlib error handler used to whether another wm is running
-    // It is set as the error handler right before selecting substructure
-    // redirection mask on the root window, so it is invoked if and only if
-    // another window manager is running
-    static int OnWMDetected(Display* display, XErrorEvent* e);
-
-     // Wheter an existing window manager has been detected, set by onWMDetected
-    static bool wm_detected_;
 
     // 
     Position<int> drag_start_pos_; 
     Position<int> drag_start_frame_pos_; 
     Size<int> drag_start_frame_size_;
 
-    // Map top level windows to their frame windows
+    // Root window geometry, the outermost snapping edges
+    Rect<int> screen_;
+
+    // Snaps frames to the screen and each other while dragging
+    Snapper snapper_;
+
+    // Last known outer geometry of every frame
+    std::unordered_map<Window, Rect<int>> frame_geometry_;
+    // Border width clients had before a frameless Frame() replaced it,
+    // restored by Unframe()
+    std::unordered_map<Window, unsigned int> original_border_width_;
+    // Frames of clients framed while unmapped, at startup, until they map.
+    // Nothing snaps to them.
+    std::unordered_set<Window> unmapped_frames_;
+
+    // Map top level windows to their frame windows.  Frameless clients are
+    // their own frame.
     std::unordered_map<Window, Window> clients_;
 
-    // Mutex for protecting wm_detected_
-    static std::mutex wm_detected_mutex_;
- 
+    // Prefetched properties of clients
+    std::unordered_map<Window, std::unique_ptr<ClientProperties>> client_properties_;
+    // Generation of the last request per client, only its result is kept.
+    // Window ids are reused, so a result for a client unframed and framed
+    // again meanwhile must not match by window alone.
+    std::unordered_map<Window, uint64_t> prefetch_generations_;
+    // tags the next request
+    uint64_t next_prefetch_generation_ = 1;
+    // Clients with a prefetched property changed in this batch, refetched
+    // once after it
+    std::unordered_set<Window> stale_properties_;
+
+    // Rule actions of clients that matched any rule
+    std::unordered_map<Window, RuleActions> client_rules_;
+    RuleStats rule_stats_;
+
+    // Ping state of clients that were asked for their protocols.  Only
+    // clients with _NET_WM_PING can be found unresponsive, a second close of
+    // one without it sends WM_DELETE_WINDOW again and never kills: a hung
+    // client can't be told apart from one asking to save changes.
+    struct PingState
+    {
+      bool supported = false;
+      // of the last ping sent, 0 if none
+      Time timestamp = 0;
+      // pending while the last ping is unanswered
+      TimerId deadline = 0;
+      // a ping went unanswered for ping_timeout, the next close kills it
+      bool unresponsive = false;
+    };
+    std::unordered_map<Window, PingState> pings_;
+
     // Handles root window
     const Window root_;
-    const Atom WM_PROTOCOLS;
-    const Atom WM_DELETE_WINDOW;
+    const Atoms atoms_;
+
+    // Events of the current event loop iteration
+    EventBatch batch_;
+    // FrameInfo of the windows the batch maps, read before any handler ran
+    std::unordered_map<Window, FrameInfo> pending_frames_;
+    EventLoopStats stats_;
+
+    // nullptr unless Config::trace_latency is set
+    std::unique_ptr<LatencyTracer> tracer_;
+    // LatencyTracer::NowMicros() when batch_ was read, if tracing
+    uint64_t batch_received_;
+
+    // nullptr unless Config::export_state is set, created by Init()
+    std::unique_ptr<StateExport> state_export_;
+
+    // EWMH root window properties, flushed once per event loop iteration
+    Ewmh ewmh_;
+
+    // Set by Stop()
+    std::atomic<bool> stop_;
+
+    // Set by Reconfigure(), taken by ProcessBatch()
+    std::shared_ptr<const Config> pending_config_;
+    std::atomic<bool> config_pending_;
+
+    // Time based work, on the backend's clock
+    TimerWheel timers_;
+    // what the backend timer is armed for, 0 if disarmed
+    uint64_t timer_deadline_;
+
+    // Fetches slow client properties on a connection of its own, nullptr
+    // if the backend can't open another one.  Declared last so it's stopped
+    // before anything it calls goes away.
+    std::unique_ptr<Prefetcher> prefetcher_;
 };
 
 #endif // WINDOW_MANAGER_H
@@ -0,0 +1,527 @@
+extern "C"
+{
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/Xproto.h>
+}
+
+#include <cerrno>
+#include <mutex>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "xlib_backend.hpp"
+#include "util.hpp"
+
+namespace
+{
+  // Backends by display, for routing the process wide error handler
+  std::mutex& RegistryMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  std::unordered_map<Display*, XlibBackend*>& Registry()
+  {
+    static std::unordered_map<Display*, XlibBackend*> registry;
+    return registry;
+  }
+}
+
+std::unique_ptr<XlibBackend> XlibBackend::Open(const std::string& disp_str)
+{
+  static std::once_flag error_handler_installed;
+  std::call_once(error_handler_installed, [] () { XSetErrorHandler(&XlibBackend::OnXError); });
+
+  const char* display_str = disp_str.empty() ? nullptr : disp_str.c_str();
+  Display* display = XOpenDisplay(display_str);
+  if(display == nullptr)
+  {
+    LOG(ERROR) << "Failed to open X display" << XDisplayName(display_str);
+    return nullptr;
+  }
+
+  return std::unique_ptr<XlibBackend>(new XlibBackend(display));
+}
+
+XlibBackend::XlibBackend(Display* display)
+    : display_(CHECK_NOTNULL(display)),
+      detecting_wm_(false),
+      wm_detected_(false),
+      wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)),
+      record_(nullptr)
+{
+  PCHECK(wake_fd_ >= 0) << "eventfd";
+  PCHECK(timer_fd_ >= 0) << "timerfd_create";
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  Registry()[display_] = this;
+}
+
+XlibBackend::~XlibBackend()
+{
+  {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    Registry().erase(display_);
+  }
+  if (record_)
+  {
+    std::fclose(record_);
+  }
+  close(wake_fd_);
+  close(timer_fd_);
+  XCloseDisplay(display_);
+}
+
+bool XlibBackend::RecordEvents(const std::string& path)
+{
+  std::FILE* file = std::fopen(path.c_str(), "ab");
+  if (file == nullptr)
+  {
+    PLOG(ERROR) << "Failed to open event recording " << path;
+    return false;
+  }
+  if (record_)
+  {
+    std::fclose(record_);
+  }
+  record_ = file;
+  LOG(INFO) << "Recording events of display " << Name() << " to " << path;
+  return true;
+}
+
+Window XlibBackend::Root()
+{
+  return DefaultRootWindow(display_);
+}
+
+std::string XlibBackend::Name()
+{
+  return XDisplayString(display_);
+}
+
+std::unique_ptr<DisplayBackend> XlibBackend::OpenConnection()
+{
+  return Open(Name());
+}
+
+void XlibBackend::Flush()
+{
+  XFlush(display_);
+}
+
+void XlibBackend::GrabServer()
+{
+  XGrabServer(display_);
+}
+
+void XlibBackend::UngrabServer()
+{
+  XUngrabServer(display_);
+}
+
+bool XlibBackend::SelectRootInput(long mask)
+{
+  // Select events on root window.  OnXError flags wm_detected_
+  // so we can exit gracefully if another wm is running
+  wm_detected_ = false;
+  detecting_wm_ = true;
+  XSelectInput(display_, DefaultRootWindow(display_), mask);
+  XSync(display_, false);
+  detecting_wm_ = false;
+  return !wm_detected_;
+}
+
+bool XlibBackend::WaitForEvents()
+{
+  if (XEventsQueued(display_, QueuedAfterReading) > 0)
+  {
+    return true;
+  }
+
+  pollfd fds[3];
+  fds[0].fd = ConnectionNumber(display_);
+  fds[0].events = POLLIN;
+  fds[1].fd = wake_fd_;
+  fds[1].events = POLLIN;
+  fds[2].fd = timer_fd_;
+  fds[2].events = POLLIN;
+  for (;;)
+  {
+    if (poll(fds, 3, -1) < 0)
+    {
+      PCHECK(errno == EINTR) << "poll";
+      continue;
+    }
+    if ((fds[1].revents | fds[2].revents) & POLLIN)
+    {
+      uint64_t count;
+      while (read(wake_fd_, &count, sizeof(count)) > 0) { }
+      while (read(timer_fd_, &count, sizeof(count)) > 0) { }
+      return XEventsQueued(display_, QueuedAfterReading) > 0;
+    }
+    // readable may just mean replies or errors
+    if (XEventsQueued(display_, QueuedAfterReading) > 0)
+    {
+      return true;
+    }
+  }
+}
+
+void XlibBackend::Wakeup()
+{
+  const uint64_t one = 1;
+  PCHECK(write(wake_fd_, &one, sizeof(one)) == sizeof(one) || errno == EAGAIN) << "eventfd write";
+}
+
+unsigned long XlibBackend::LastRequestSerial()
+{
+  return NextRequest(display_) - 1;
+}
+
+uint64_t XlibBackend::Now()
+{
+  timespec now;
+  PCHECK(clock_gettime(CLOCK_MONOTONIC, &now) == 0) << "clock_gettime";
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+void XlibBackend::SetTimer(uint64_t deadline)
+{
+  // absolute, so a late call can't push the deadline back; an all zero
+  // it_value disarms
+  itimerspec spec = {};
+  spec.it_value.tv_sec = deadline / 1000;
+  spec.it_value.tv_nsec = (deadline % 1000) * 1000000;
+  PCHECK(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) << "timerfd_settime";
+}
+
+void XlibBackend::NextEvent(XEvent* event)
+{
+  XNextEvent(display_, event);
+  if (record_)
+  {
+    std::fwrite(event, sizeof(*event), 1, record_);
+  }
+}
+
+int XlibBackend::EventsQueued()
+{
+  return XEventsQueued(display_, QueuedAfterReading);
+}
+
+Atom XlibBackend::InternAtom(const char* name, bool only_if_exists)
+{
+  return XInternAtom(display_, name, only_if_exists);
+}
+
+bool XlibBackend::InternAtoms(const char* const* names, int count, bool only_if_exists, Atom* atoms)
+{
+  return XInternAtoms(display_, const_cast<char**>(names), count, only_if_exists, atoms);
+}
+
+KeyCode XlibBackend::KeysymToKeycode(KeySym keysym)
+{
+  return XKeysymToKeycode(display_, keysym);
+}
+
+bool XlibBackend::QueryTree(Window win, std::vector<Window>* children)
+{
+  Window returned_root, returned_parent;
+  Window* top_level_windows;
+  unsigned int num_top_level_windows;
+  if (!XQueryTree(display_, win, &returned_root, &returned_parent, &top_level_windows, &num_top_level_windows))
+  {
+    return false;
+  }
+  children->assign(top_level_windows, top_level_windows + num_top_level_windows);
+  XFree(top_level_windows);
+  return true;
+}
+
+bool XlibBackend::GetWindowAttributes(Window win, XWindowAttributes* attrs)
+{
+  return XGetWindowAttributes(display_, win, attrs);
+}
+
+bool XlibBackend::GetGeometry(Window win,
+                              int* x,
+                              int* y,
+                              unsigned int* width,
+                              unsigned int* height,
+                              unsigned int* border_width)
+{
+  Window returned_root;
+  unsigned int depth;
+  return XGetGeometry(display_, win, &returned_root, x, y, width, height, border_width, &depth);
+}
+
+bool XlibBackend::GetWMProtocols(Window win, std::vector<Atom>* protocols)
+{
+  Atom* supported_protocols;
+  int num_supported_protocols;
+  if (!XGetWMProtocols(display_, win, &supported_protocols, &num_supported_protocols))
+  {
+    return false;
+  }
+  protocols->assign(supported_protocols, supported_protocols + num_supported_protocols);
+  XFree(supported_protocols);
+  return true;
+}
+
+bool XlibBackend::GetStringProperty(Window win, Atom property, std::string* value)
+{
+  // titles past 64KiB are cut off
+  const long MAX_LONGS = 16384;
+  Atom type;
+  int format;
+  unsigned long num_items, bytes_after;
+  unsigned char* data = nullptr;
+  if (XGetWindowProperty(display_, win, property, 0, MAX_LONGS, False, AnyPropertyType,
+                         &type, &format, &num_items, &bytes_after, &data) != Success)
+  {
+    return false;
+  }
+  const bool found = type != None && format == 8;
+  if (found)
+  {
+    value->assign(reinterpret_cast<const char*>(data), num_items);
+  }
+  if (data)
+  {
+    XFree(data);
+  }
+  return found;
+}
+
+bool XlibBackend::GetTextProperty(Window win, Atom property, std::string* utf8)
+{
+  XTextProperty text;
+  if (!XGetTextProperty(display_, win, &text, property) || text.value == nullptr)
+  {
+    return false;
+  }
+  char** list = nullptr;
+  int count = 0;
+  const int status = Xutf8TextPropertyToTextList(display_, &text, &list, &count);
+  XFree(text.value);
+  if (status < Success || list == nullptr)
+  {
+    return false;
+  }
+  utf8->clear();
+  for (int i = 0; i < count; ++i)
+  {
+    utf8->append(list[i]);
+  }
+  XFreeStringList(list);
+  return true;
+}
+
+bool XlibBackend::GetCardinalProperty(Window win, Atom property, std::vector<unsigned long>* values)
+{
+  // 16MiB, a few large icons
+  const long MAX_LONGS = 1 << 22;
+  Atom type;
+  int format;
+  unsigned long num_items, bytes_after;
+  unsigned char* data = nullptr;
+  if (XGetWindowProperty(display_, win, property, 0, MAX_LONGS, False, XA_CARDINAL,
+                         &type, &format, &num_items, &bytes_after, &data) != Success)
+  {
+    return false;
+  }
+  const bool found = type == XA_CARDINAL && format == 32;
+  if (found)
+  {
+    // format 32 comes back as longs
+    const unsigned long* items = reinterpret_cast<const unsigned long*>(data);
+    values->assign(items, items + num_items);
+  }
+  if (data)
+  {
+    XFree(data);
+  }
+  return found;
+}
+
+Window XlibBackend::CreateSimpleWindow(Window parent,
+                                       int x,
+                                       int y,
+                                       unsigned int width,
+                                       unsigned int height,
+                                       unsigned int border_width,
+                                       unsigned long border,
+                                       unsigned long background)
+{
+  return XCreateSimpleWindow(display_, parent, x, y, width, height, border_width, border, background);
+}
+
+void XlibBackend::DestroyWindow(Window win)
+{
+  XDestroyWindow(display_, win);
+}
+
+void XlibBackend::SelectInput(Window win, long mask)
+{
+  XSelectInput(display_, win, mask);
+}
+
+void XlibBackend::SetWindowBorder(Window win, unsigned long border)
+{
+  XSetWindowBorder(display_, win, border);
+}
+
+void XlibBackend::AddToSaveSet(Window win)
+{
+  XAddToSaveSet(display_, win);
+}
+
+void XlibBackend::RemoveFromSaveSet(Window win)
+{
+  XRemoveFromSaveSet(display_, win);
+}
+
+void XlibBackend::ReparentWindow(Window win, Window parent, int x, int y)
+{
+  XReparentWindow(display_, win, parent, x, y);
+}
+
+void XlibBackend::MapWindow(Window win)
+{
+  XMapWindow(display_, win);
+}
+
+void XlibBackend::UnmapWindow(Window win)
+{
+  XUnmapWindow(display_, win);
+}
+
+void XlibBackend::ConfigureWindow(Window win, unsigned int value_mask, XWindowChanges* changes)
+{
+  XConfigureWindow(display_, win, value_mask, changes);
+}
+
+void XlibBackend::MoveWindow(Window win, int x, int y)
+{
+  XMoveWindow(display_, win, x, y);
+}
+
+void XlibBackend::ResizeWindow(Window win, unsigned int width, unsigned int height)
+{
+  XResizeWindow(display_, win, width, height);
+}
+
+void XlibBackend::RaiseWindow(Window win)
+{
+  XRaiseWindow(display_, win);
+}
+
+void XlibBackend::SetInputFocus(Window win, int revert_to, Time time)
+{
+  XSetInputFocus(display_, win, revert_to, time);
+}
+
+void XlibBackend::KillClient(XID resource)
+{
+  XKillClient(display_, resource);
+}
+
+bool XlibBackend::SendEvent(Window win, bool propagate, long event_mask, XEvent* event)
+{
+  return XSendEvent(display_, win, propagate, event_mask, event);
+}
+
+void XlibBackend::ChangeProperty(Window win,
+                                 Atom property,
+                                 Atom type,
+                                 int format,
+                                 int mode,
+                                 const unsigned char* data,
+                                 int nelements)
+{
+  XChangeProperty(display_, win, property, type, format, mode, data, nelements);
+}
+
+void XlibBackend::GrabButton(unsigned int button,
+                             unsigned int modifiers,
+                             Window grab_window,
+                             bool owner_events,
+                             unsigned int event_mask)
+{
+  XGrabButton(
+      display_,
+      button,
+      modifiers,
+      grab_window,
+      owner_events,
+      event_mask,
+      GrabModeAsync,
+      GrabModeAsync,
+      None,
+      None);
+}
+
+void XlibBackend::GrabKey(int keycode,
+                          unsigned int modifiers,
+                          Window grab_window,
+                          bool owner_events)
+{
+  XGrabKey(
+      display_,
+      keycode,
+      modifiers,
+      grab_window,
+      owner_events,
+      GrabModeAsync,
+      GrabModeAsync);
+}
+
+void XlibBackend::UngrabButton(unsigned int button, unsigned int modifiers, Window grab_window)
+{
+  XUngrabButton(display_, button, modifiers, grab_window);
+}
+
+void XlibBackend::UngrabKey(int keycode, unsigned int modifiers, Window grab_window)
+{
+  XUngrabKey(display_, keycode, modifiers, grab_window);
+}
+
+int XlibBackend::OnXError(Display* display, XErrorEvent* e)
+{
+  XlibBackend* backend = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    auto i = Registry().find(display);
+    if (i != Registry().end())
+    {
+      backend = i->second;
+    }
+  }
+  if (backend && backend->detecting_wm_)
+  {
+    // in the case of another wm, the error code from XSelectInput
+    // is BadAccess.  We don't expect any other errors.
+    CHECK_EQ(static_cast<int>(e->error_code), BadAccess);
+    CHECK_EQ(static_cast<int>(e->request_code), X_ChangeWindowAttributes);
+    backend->wm_detected_ = true;
+    return 0;
+  }
+
+  const int MAX_ERR_LEN = 1024;
+  char ERR_TXT[MAX_ERR_LEN];
+  XGetErrorText(display, e->error_code, ERR_TXT, sizeof(ERR_TXT));
+  LOG(ERROR) << "Received X error:\n"
+             << "    Request: " << int(e->request_code)
+             << " - " << XRequestCodeToString(e->request_code) << "\n"
+             << "    Error code: " << int(e->error_code)
+             << " - " << ERR_TXT << "\n"
+             << "    Resource ID: " << e->resourceid;
+  // The return value is ignored.
+  return 0;
+}
@@ -0,0 +1,134 @@
+#ifndef XLIB_BACKEND_HPP
+#define XLIB_BACKEND_HPP
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "display_backend.hpp"
+
+// DisplayBackend talking to a real X server through Xlib.  Any number of
+// instances can live in one process, each on its own thread (XInitThreads()
+// must have been called).
+class XlibBackend : public DisplayBackend
+{
+  public:
+    // Connects to disp_str, or $DISPLAY if empty.  Returns nullptr on failure.
+    static std::unique_ptr<XlibBackend> Open(const std::string& disp_str = std::string());
+
+    // Disconnects from xserver
+    ~XlibBackend() override;
+
+    // Appends every event returned by NextEvent() as a raw XEvent to path,
+    // the format read back by tools/replay
+    bool RecordEvents(const std::string& path);
+
+    Display* display() const { return display_; }
+
+    Window Root() override;
+    std::string Name() override;
+    void Flush() override;
+    void GrabServer() override;
+    void UngrabServer() override;
+    std::unique_ptr<DisplayBackend> OpenConnection() override;
+    bool SelectRootInput(long mask) override;
+
+    bool WaitForEvents() override;
+    void Wakeup() override;
+    void NextEvent(XEvent* event) override;
+    int EventsQueued() override;
+    unsigned long LastRequestSerial() override;
+
+    uint64_t Now() override;
+    void SetTimer(uint64_t deadline) override;
+
+    Atom InternAtom(const char* name, bool only_if_exists) override;
+    bool InternAtoms(const char* const* names, int count, bool only_if_exists, Atom* atoms) override;
+    KeyCode KeysymToKeycode(KeySym keysym) override;
+
+    bool QueryTree(Window win, std::vector<Window>* children) override;
+    bool GetWindowAttributes(Window win, XWindowAttributes* attrs) override;
+    bool GetGeometry(Window win,
+                     int* x,
+                     int* y,
+                     unsigned int* width,
+                     unsigned int* height,
+                     unsigned int* border_width) override;
+    bool GetWMProtocols(Window win, std::vector<Atom>* protocols) override;
+    bool GetStringProperty(Window win, Atom property, std::string* value) override;
+    bool GetTextProperty(Window win, Atom property, std::string* utf8) override;
+    bool GetCardinalProperty(Window win, Atom property, std::vector<unsigned long>* values) override;
+
+    Window CreateSimpleWindow(Window parent,
+                              int x,
+                              int y,
+                              unsigned int width,
+                              unsigned int height,
+                              unsigned int border_width,
+                              unsigned long border,
+                              unsigned long background) override;
+    void DestroyWindow(Window win) override;
+    void SelectInput(Window win, long mask) override;
+    void SetWindowBorder(Window win, unsigned long border) override;
+    void AddToSaveSet(Window win) override;
+    void RemoveFromSaveSet(Window win) override;
+    void ReparentWindow(Window win, Window parent, int x, int y) override;
+    void MapWindow(Window win) override;
+    void UnmapWindow(Window win) override;
+    void ConfigureWindow(Window win, unsigned int value_mask, XWindowChanges* changes) override;
+    void MoveWindow(Window win, int x, int y) override;
+    void ResizeWindow(Window win, unsigned int width, unsigned int height) override;
+    void RaiseWindow(Window win) override;
+    void SetInputFocus(Window win, int revert_to, Time time) override;
+    void KillClient(XID resource) override;
+    bool SendEvent(Window win, bool propagate, long event_mask, XEvent* event) override;
+    void ChangeProperty(Window win,
+                        Atom property,
+                        Atom type,
+                        int format,
+                        int mode,
+                        const unsigned char* data,
+                        int nelements) override;
+
+    void GrabButton(unsigned int button,
+                    unsigned int modifiers,
+                    Window grab_window,
+                    bool owner_events,
+                    unsigned int event_mask) override;
+    void GrabKey(int keycode,
+                 unsigned int modifiers,
+                 Window grab_window,
+                 bool owner_events) override;
+    void UngrabButton(unsigned int button, unsigned int modifiers, Window grab_window) override;
+    void UngrabKey(int keycode, unsigned int modifiers, Window grab_window) override;
+
+  private:
+    // Invoked by Open()
+    XlibBackend(Display* display);
+
+    // Xlib error handler.  Xlib only has one per process, so it looks up the
+    // backend owning the display and handles the error on its behalf.
+    static int OnXError(Display* display, XErrorEvent* e);
+
+    // Underlying display struct
+    Display* display_;
+
+    // Set while SelectRootInput() waits for the result of selecting
+    // substructure redirection, during which a BadAccess error means another
+    // window manager is running
+    bool detecting_wm_;
+
+    // Wheter an existing window manager has been detected, set by OnXError
+    bool wm_detected_;
+
+    // eventfd interrupting WaitForEvents()
+    int wake_fd_;
+
+    // timerfd behind SetTimer(), polled with the connection
+    int timer_fd_;
+
+    // Event recording, nullptr unless RecordEvents() was called
+    std::FILE* record_;
+};
+
+#endif // XLIB_BACKEND_HPP